@@ -7,6 +7,10 @@ struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct page_stat;
+struct vmstat;
+struct vma;
+struct vmamap;
 struct superblock;
 
 // bio.c
@@ -59,6 +63,12 @@ void            ireclaim(int);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void*           ksuperalloc(void);
+uint64          kfreepages(void);
+extern char     *zeropage;
+void            kref(void *);
+int             krefcnt(void *);
+void            ksuperfree(void *);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -80,6 +90,7 @@ void            printfinit(void);
 // proc.c
 int             cpuid(void);
 void            kexit(int);
+void            kthread(char*, void (*)(void));
 int             kfork(void);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
@@ -143,6 +154,10 @@ void            trapinithart(void);
 extern struct spinlock tickslock;
 void            prepare_return(void);
 
+// uaccess.S
+int             ucopy(char*, char*, uint64);
+int             ucopystr(char*, char*, uint64);
+
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
@@ -164,11 +179,18 @@ void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
+pte_t *         walklevel(pagetable_t, uint64, int, int*);
+char *          uvmsuper(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 int             ismapped(pagetable_t, uint64);
+uint64          uvmsatp(struct proc*);
+void            uvmfence(struct proc*, uint64);
+pagetable_t     uwinalloc(void);
+void            kvmswitch(struct proc*);
+uint64          uaccess_fault(uint64, uint64, int);
 uint64          vmfault(pagetable_t, uint64, int);
 
 // lazy.c - lazy allocation and demand paging
@@ -177,8 +199,18 @@ void            lazy_alloc_mem(struct proc *p);
 void            lazy_free(struct proc *p);
 int             lazy_handle_fault(struct proc *p, uint64 va, int write_fault);
 int             lazy_evict_page(struct proc *p);
+void            lazy_zfree(struct proc *p);
+void            lazy_reset(struct proc *p);
+int             lazy_fork(struct proc *p, struct proc *np);
+void            lazy_predict(struct proc *p, uint64 va, int write);
+int             lazy_pagestat(struct proc*, uint64*, struct page_stat*, int);
+int             memstat(int, uint64, uint64, int);
+void            vmstatfill(struct vmstat*);
+int             faultstatout(uint64);
+extern struct vmstat vmstat;
+#define VMSTAT_INC(f) __sync_fetch_and_add(&vmstat.f, 1)
 
-// demand_paging.c
+// lazy.c - page info and the swap file
 void            demand_paging_init(struct proc*);
 struct page_info* get_page_info(struct proc*, uint64);
 int             alloc_swap_slot(struct proc*);
@@ -192,6 +224,43 @@ int             evict_page(struct proc*, uint64);
 int             handle_page_fault(struct proc*, uint64, int);
 int             handle_write_fault(struct proc*, uint64);
 
+// thrash.c
+void            thrashinit(void);
+void            thrash_fault(struct proc*);
+void            thrash_io(uint64);
+void            thrash_check(void);
+void            thrash_park(struct proc*);
+int             thrash_reclaim(void);
+
+// ksm.c
+void            ksminit(void);
+int             ksmrate(int);
+void            ksmdrop(char*);
+int             ksmclaim(pte_t*, char*);
+
+// vma.c
+int             vmaadd(struct vmamap*, uint64, uint64, int, int, struct inode*, uint64, uint64);
+struct vma*     vmalookup(struct proc*, uint64);
+
+// timer.c
+void            timer_tick(void);
+int             timer_sleep(uint);
+
+// zswap.c
+void            zswapinit(void);
+int             zswapstore(char*);
+void            zswapload(int, char*);
+void            zswapread(int, char*);
+void            zswapfree(int);
+int             zswapctl(int);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, int, uint64, uint64);
+void            tracedump(void);
+int             traceread(uint64, int);
+extern int      traceecho;
+
 // sysfile.c
 struct inode*   create(char*, short, short, short);
 
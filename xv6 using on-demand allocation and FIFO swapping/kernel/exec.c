@@ -9,6 +9,7 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "trace.h"
 
 // Removed loadseg() - no longer needed for demand paging
 
@@ -38,20 +39,14 @@ kexec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
-  uint64 text_start = 0xFFFFFFFFFFFFFFFF, text_end = 0;
-  uint64 data_start = 0xFFFFFFFFFFFFFFFF, data_end = 0;
+  struct vmamap vm;
   // Disabled: struct inode *old_exec_inode;
   int ip_locked = 0;  // Track if ip is locked
   
   // Disabled: Save the old exec_inode before we potentially overwrite it
   // old_exec_inode = p->exec_inode;
   
-  // Clear old exec information
-  for(i = 0; i < MAX_PROC_PAGES; i++) {
-    p->exec_off[i] = 0;
-    p->exec_len[i] = 0;
-  }
-  p->num_pages = 0;
+  vm.n = 0;
 
   begin_op();
 
@@ -91,41 +86,11 @@ kexec(char *path, char **argv)
     // Determine if this is text or data
     int is_exec = (ph.flags & 0x1) != 0; // Executable flag
     
-    if(is_exec) {
-      // Text segment
-      if(ph.vaddr < text_start)
-        text_start = ph.vaddr;
-      if(ph.vaddr + ph.memsz > text_end)
-        text_end = ph.vaddr + ph.memsz;
-    } else {
-      // Data segment
-      if(ph.vaddr < data_start)
-        data_start = ph.vaddr;
-      if(ph.vaddr + ph.memsz > data_end)
-        data_end = ph.vaddr + ph.memsz;
-    }
-    
-    // Record page information for demand loading
-    for(uint64 va = ph.vaddr; va < ph.vaddr + ph.memsz; va += PGSIZE) {
-      struct page_info *pi = get_page_info(p, va);
-      if(pi) {
-        pi->va = va;
-        pi->state = UNMAPPED;
-        // Store file offset for this page
-        uint64 page_off = va - ph.vaddr;
-        int page_idx = (pi - p->pages);
-        
-        if(page_off < ph.filesz) {
-          p->exec_off[page_idx] = ph.off + page_off;
-          // Calculate how many bytes to read from this page
-          uint64 bytes_left = ph.filesz - page_off;
-          p->exec_len[page_idx] = (bytes_left > PGSIZE) ? PGSIZE : bytes_left;
-        } else {
-          p->exec_off[page_idx] = 0; // BSS section
-          p->exec_len[page_idx] = 0;
-        }
-      }
-    }
+    // Record the segment for demand loading
+    if(vmaadd(&vm, ph.vaddr, PGROUNDUP(ph.vaddr + ph.memsz),
+              is_exec ? VMA_TEXT : VMA_DATA, PTE_R | flags2perm(ph.flags),
+              ip, ph.off, ph.filesz) < 0)
+      goto bad;
     
     // Update sz to track end of program
     if(ph.vaddr + ph.memsz > sz)
@@ -147,15 +112,10 @@ kexec(char *path, char **argv)
   sp = sz + (USERSTACK+1)*PGSIZE;
   stackbase = sp - USERSTACK*PGSIZE;
   
-  // Store memory layout in proc structure BEFORE any copyout operations
-  // This is critical because copyout can trigger page faults during exec
-  p->text_start = text_start;
-  p->text_end = text_end;
-  p->data_start = data_start;
-  p->data_end = data_end;
-  p->heap_start = PGROUNDUP(data_end);
-  p->stack_top = sz + (USERSTACK+1)*PGSIZE; // Top of stack region (absolute address)
-  p->sz = sz + (USERSTACK+1)*PGSIZE;
+  // The stack, below a guard page, and the heap above it.
+  if(vmaadd(&vm, stackbase, sp, VMA_STACK, PTE_R | PTE_W, 0, 0, 0) < 0 ||
+     vmaadd(&vm, sp, MAXVA, VMA_HEAP, PTE_R | PTE_W, 0, 0, 0) < 0)
+    goto bad;
   
   // Allocate physical pages for stack temporarily to write arguments
   // These will be the only pages allocated eagerly
@@ -170,14 +130,6 @@ kexec(char *path, char **argv)
     goto bad;
   }
   
-  // Track this stack page in page info
-  struct page_info *stack_pi = get_page_info(p, stackbase);
-  if(stack_pi) {
-    stack_pi->state = RESIDENT;
-    stack_pi->seq = p->next_fifo_seq++;
-    stack_pi->is_dirty = 0;
-  }
-  
   sp = stackbase + PGSIZE;
 
   // Copy argument strings into stack
@@ -212,12 +164,35 @@ kexec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  // under p->lock, so that memstat() isn't walking the old
+  // page table when we free it.
+  // The layout goes in only now: until here a failure returns
+  // to the old image, and copyout() above wrote through
+  // pagetable, not p's areas.
+  acquire(&p->lock);
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
-  // NOTE: p->sz and memory layout fields were already set earlier, before copyout
+  p->asid = 0;  // new address space, new ASID
+  p->vm = vm;
+  p->stack_top = sz + (USERSTACK+1)*PGSIZE; // Top of stack region (absolute address)
+  p->sz = sz + (USERSTACK+1)*PGSIZE;
+  release(&p->lock);
+#ifdef USERMAP
+  kvmswitch(p); // point the user window at the new page table
+#endif
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  lazy_reset(p);  // the old image's page info, swap slots and compressed pages
+
+  // Track the stack page in page info
+  struct page_info *stack_pi = get_page_info(p, stackbase);
+  if(stack_pi) {
+    stack_pi->va = stackbase;
+    stack_pi->state = RESIDENT;
+    stack_pi->seq = p->next_fifo_seq++;
+    stack_pi->is_dirty = 0;
+  }
   
   // Now that we've committed, set the new exec_inode
   // We need to keep ip referenced, so call idup() to increment ref count
@@ -230,9 +205,9 @@ kexec(char *path, char **argv)
   //   // Non-fatal - swapping just won't work
   // }
   
-  // Log the lazy map initialization
-  printf("[pid %d] INIT-LAZYMAP text=[0x%lx,0x%lx) data=[0x%lx,0x%lx) heap_start=0x%lx stack_top=0x%lx\n",
-         p->pid, text_start, text_end, data_start, data_end, p->heap_start, p->stack_top);
+  // Log the lazy map initialization, an area at a time
+  for(i = 0; i < p->vm.n; i++)
+    trace(TR_LAZYMAP, p->pid, p->vm.vma[i].start | p->vm.vma[i].type, p->vm.vma[i].end);
   
   // Don't release old_exec_inode - just let it leak for now
   // This avoids potential ilock panics
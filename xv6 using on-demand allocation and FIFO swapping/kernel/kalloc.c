@@ -1,6 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// and 2-megabyte superpages for large user heaps.
+//
+// Free memory is kept as superpages for as long as possible.
+// When the list of single pages runs dry, kalloc() breaks up
+// a superpage. Single pages are never merged back.
+//
+// Single pages can be shared (see ksm.c): kref() adds a
+// reference, and kfree() only frees the page when it drops
+// the last one.
 
 #include "types.h"
 #include "param.h"
@@ -21,13 +30,25 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  struct run *superlist;  // free superpages, SUPERPGSIZE-aligned
+  uint64 nfree;           // free pages, counting superpages' pages
+  ushort ref[(PHYSTOP - KERNBASE) / PGSIZE];  // references to each page
 } kmem;
 
+#define PGREF(pa) kmem.ref[((uint64)(pa) - KERNBASE) / PGSIZE]
+
+// A page of zeros that read faults on untouched heap and bss
+// map read-only in any number of processes. Never freed.
+char *zeropage;
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
   freerange(end, (void*)PHYSTOP);
+  if((zeropage = kalloc()) == 0)
+    panic("kinit: zeropage");
+  memset(zeropage, 0, PGSIZE);
 }
 
 void
@@ -35,8 +56,15 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  while(p + PGSIZE <= (char*)pa_end){
+    if((uint64)p % SUPERPGSIZE == 0 && p + SUPERPGSIZE <= (char*)pa_end){
+      ksuperfree(p);
+      p += SUPERPGSIZE;
+    } else {
+      kfree(p);
+      p += PGSIZE;
+    }
+  }
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -50,6 +78,18 @@ kfree(void *pa)
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
+  if(pa == zeropage)
+    return;  // still mapped elsewhere
+
+  acquire(&kmem.lock);
+  if(PGREF(pa) > 1){
+    // still mapped elsewhere
+    PGREF(pa)--;
+    release(&kmem.lock);
+    return;
+  }
+  PGREF(pa) = 0;
+  release(&kmem.lock);
 
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
@@ -59,6 +99,7 @@ kfree(void *pa)
   acquire(&kmem.lock);
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
@@ -71,12 +112,97 @@ kalloc(void)
   struct run *r;
 
   acquire(&kmem.lock);
+  if(kmem.freelist == 0 && kmem.superlist){
+    // out of single pages: break up a superpage.
+    char *sp = (char*)kmem.superlist;
+    kmem.superlist = kmem.superlist->next;
+    for(char *p = sp; p < sp + SUPERPGSIZE; p += PGSIZE){
+      r = (struct run*)p;
+      r->next = kmem.freelist;
+      kmem.freelist = r;
+    }
+  }
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+    PGREF(r) = 1;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Free a superpage of physical memory, which normally
+// should have been returned by ksuperalloc().
+void
+ksuperfree(void *pa)
+{
+  struct run *r;
+
+  if(((uint64)pa % SUPERPGSIZE) != 0 || (char*)pa < end || (uint64)pa + SUPERPGSIZE > PHYSTOP)
+    panic("ksuperfree");
+
+  // Fill with junk to catch dangling refs.
+  memset(pa, 1, SUPERPGSIZE);
+
+  r = (struct run*)pa;
+
+  acquire(&kmem.lock);
+  r->next = kmem.superlist;
+  kmem.superlist = r;
+  kmem.nfree += SUPERPGSIZE / PGSIZE;
+  release(&kmem.lock);
+}
+
+// Allocate one physically contiguous, SUPERPGSIZE-aligned
+// superpage. Returns 0 if none is free; the caller should
+// fall back to single pages.
+void *
+ksuperalloc(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = kmem.superlist;
+  if(r){
+    kmem.superlist = r->next;
+    kmem.nfree -= SUPERPGSIZE / PGSIZE;
+    // a superpage may be split later, and its pages
+    // freed one at a time.
+    for(int i = 0; i < SUPERPGSIZE / PGSIZE; i++)
+      PGREF((char*)r + i*PGSIZE) = 1;
+  }
+  release(&kmem.lock);
+
+  if(r)
+    memset((char*)r, 5, SUPERPGSIZE); // fill with junk
+  return (void*)r;
+}
+
+// Number of free pages, for vmstat().
+uint64
+kfreepages(void)
+{
+  return kmem.nfree;
+}
+
+// Add a reference to page pa, which must be allocated.
+void
+kref(void *pa)
+{
+  acquire(&kmem.lock);
+  if(PGREF(pa) == 0 || PGREF(pa) == 0xffff)
+    panic("kref");
+  PGREF(pa)++;
+  release(&kmem.lock);
+}
+
+// Number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  return PGREF(pa);
+}
@@ -0,0 +1,263 @@
+//
+// Kernel same-page merging.
+//
+// A kernel thread walks the user page tables of all processes a
+// few pages per tick, looking for anonymous pages (data, bss,
+// heap and stack) with the same contents. It maps all but one of
+// them to the same frame, read-only and marked PTE_COW, and
+// frees the rest. kalloc.c counts the references to the shared
+// frame, and a write to any of its mappings takes a fault that
+// gives the writer its own copy again (lazy_cow()). All-zero
+// pages are merged into the shared zero page.
+//
+// Pages are found by a hash of their contents. The first page
+// seen with a hash becomes the candidate for it: the scanner
+// write-protects it (PTE_COW again) so that it can't change
+// while it waits, and holds a reference to its frame. A later
+// page with the same hash and the same bytes is merged into the
+// candidate. The candidates are dropped at the end of each pass
+// over all processes, or when their owner writes to them.
+//
+// The scanner only touches a process's page table while holding
+// its p->lock and while it isn't RUNNING, so no hart can be
+// writing to a page through a stale TLB entry while it is being
+// compared; uvmfence() makes the process flush before it runs.
+// Nor may the process be holding the physical address of one of
+// its pages, as copyout() does between walkaddr() and memmove(),
+// since the scanner may free that frame. So the process must be
+// preempted on its way back to user space (p->atuser), or asleep:
+// the only sleep with a frame in hand is lazy_evict_page()'s
+// writei(), which holds a reference to it. Processes parked by
+// load control are left alone, since other processes evict their
+// pages without their p->lock.
+//
+// Off until ksm() sets a scan rate.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NKSM 1024  // candidate table size
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;  // rate and cand
+  int rate;            // pages per tick, 0 if off
+  struct proc *p;      // scan cursor: process
+  uint64 va;           // and address in it
+  struct {
+    uint64 hash;
+    char *pa;          // candidate frame, referenced, or 0
+  } cand[NKSM];
+} ksm;
+
+static uint64 zerohash;
+
+// 64-bit FNV-1a over the page, a word at a time.
+static uint64
+pagehash(char *pa)
+{
+  uint64 h = 14695981039346656037UL;
+  uint64 *w = (uint64*)pa;
+
+  for(int i = 0; i < PGSIZE / sizeof(uint64); i++){
+    h ^= w[i];
+    h *= 1099511628211UL;
+  }
+  return h;
+}
+
+// Look at p's page at va, and merge it if there is a twin.
+// Called with p->lock held, p not running.
+static void
+ksmpage(struct proc *p, uint64 va)
+{
+  pte_t *pte;
+  char *pa;
+  uint64 h;
+  int level, i, w;
+
+  pte = walklevel(p->pagetable, va, 0, &level);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || level != 0)
+    return;
+  if((*pte & (PTE_W | PTE_COW)) == 0)
+    return;  // text, or otherwise read-only
+  pa = (char*)PTE2PA(*pte);
+  if(pa == zeropage)
+    return;
+  VMSTAT_INC(ksm_scanned);
+
+  h = pagehash(pa);
+  i = h % NKSM;
+  acquire(&ksm.lock);
+  if(h == zerohash && memcmp(pa, zeropage, PGSIZE) == 0){
+    *pte = PA2PTE(zeropage) | (PTE_FLAGS(*pte) & ~PTE_W) | PTE_COW;
+    release(&ksm.lock);
+    goto merged;
+  }
+
+  if(ksm.cand[i].pa == pa){
+    release(&ksm.lock);
+    return;
+  }
+  if(ksm.cand[i].pa && ksm.cand[i].hash == h && memcmp(ksm.cand[i].pa, pa, PGSIZE) == 0){
+    kref(ksm.cand[i].pa);
+    *pte = PA2PTE(ksm.cand[i].pa) | (PTE_FLAGS(*pte) & ~PTE_W) | PTE_COW;
+    release(&ksm.lock);
+    goto merged;
+  }
+
+  // make it the candidate for h, in place of any other.
+  if(ksm.cand[i].pa)
+    kfree(ksm.cand[i].pa);
+  kref(pa);
+  ksm.cand[i].pa = pa;
+  ksm.cand[i].hash = h;
+  w = *pte & PTE_W;
+  *pte = (*pte & ~PTE_W) | PTE_COW;
+  release(&ksm.lock);
+  if(w)
+    uvmfence(p, va);
+  return;
+
+merged:
+  uvmfence(p, va);
+  kfree(pa);
+  VMSTAT_INC(ksm_merged);
+  VMSTAT_INC(ksm_saved);
+}
+
+// Drop the candidates at the end of a pass.
+static void
+ksmflush(void)
+{
+  acquire(&ksm.lock);
+  for(int i = 0; i < NKSM; i++){
+    if(ksm.cand[i].pa)
+      kfree(ksm.cand[i].pa);
+    ksm.cand[i].pa = 0;
+  }
+  release(&ksm.lock);
+}
+
+// Called before a write to pa copies it: if pa is a merge
+// candidate, stop holding it, so its owner may have it back
+// without a copy.
+void
+ksmdrop(char *pa)
+{
+  int i = pagehash(pa) % NKSM;
+
+  acquire(&ksm.lock);
+  if(ksm.cand[i].pa == pa){
+    kfree(pa);
+    ksm.cand[i].pa = 0;
+  }
+  release(&ksm.lock);
+}
+
+// Called by lazy_cow() for a write to the copy-on-write page at
+// pte, which mapped pa. If pte still maps pa and nothing else
+// refers to it, make it writable in place and return 1; return 0
+// if it must be copied. ksm.lock keeps the scanner from taking a
+// reference to pa meanwhile.
+int
+ksmclaim(pte_t *pte, char *pa)
+{
+  int r = 0;
+
+  acquire(&ksm.lock);
+  if((*pte & PTE_V) && (*pte & PTE_COW) && PTE2PA(*pte) == (uint64)pa &&
+     krefcnt(pa) == 1){
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+    r = 1;
+  }
+  release(&ksm.lock);
+  return r;
+}
+
+// Scan up to n pages, carrying on from where the last call
+// stopped.
+static void
+ksmscan(int n)
+{
+  struct proc *p;
+
+  while(n > 0){
+    p = ksm.p;
+    acquire(&p->lock);
+    // p->parked is stable while p sleeps in thrash_park().
+    if(((p->state == RUNNABLE && p->atuser) || (p->state == SLEEPING && !p->parked)) &&
+       p->kthread == 0 && p->pagetable){
+      for(; ksm.va < p->sz && n > 0; ksm.va += PGSIZE, n--)
+        ksmpage(p, ksm.va);
+      if(ksm.va < p->sz){
+        release(&p->lock);
+        return;
+      }
+    } else {
+      n--;
+    }
+    release(&p->lock);
+
+    // on to the next process.
+    ksm.va = 0;
+    if(++ksm.p == &proc[NPROC]){
+      ksm.p = proc;
+      ksmflush();
+    }
+  }
+}
+
+// The scanner thread.
+static void
+ksmd(void)
+{
+  int n;
+
+  for(;;){
+    acquire(&ksm.lock);
+    while(ksm.rate == 0)
+      sleep(&ksm.rate, &ksm.lock);
+    n = ksm.rate;
+    release(&ksm.lock);
+
+    ksmscan(n);
+
+    timer_sleep(1);
+  }
+}
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+  ksm.p = proc;
+  zerohash = pagehash(zeropage);
+  kthread("ksmd", ksmd);
+}
+
+// Set the scan rate in pages per tick; 0 turns merging off.
+// Returns the old rate.
+int
+ksmrate(int rate)
+{
+  int old;
+
+  acquire(&ksm.lock);
+  old = ksm.rate;
+  ksm.rate = rate;
+  vmstat.ksm_rate = rate;
+  release(&ksm.lock);
+  // wakeup() takes every p->lock, and ksmscan() takes ksm.lock
+  // under a p->lock, so don't hold ksm.lock here. ksmd rechecks
+  // the rate under ksm.lock, so the wakeup can't be lost.
+  wakeup(&ksm.rate);
+  return old;
+}
@@ -11,6 +11,32 @@
 #include "fs.h"
 #include "file.h"
 #include "stat.h"
+#include "trace.h"
+
+extern struct proc proc[NPROC];
+
+struct vmstat vmstat;  // system-wide counters; see vmstatfill()
+
+// Fault latencies. Each hart updates only its own
+// rows, with interrupts off, so no lock is needed.
+struct faultstat faultstat;
+
+// Record a fault of the given cause that began at time t0.
+static void
+faultlat(int cause, uint64 t0)
+{
+  uint64 d = r_time() - t0;
+  int b, id;
+
+  for(b = 0; b < NFLBUCKET - 1 && (d >> (b + 1)) != 0; b++)
+    ;
+  push_off();
+  id = cpuid();
+  faultstat.hist[id][cause][b]++;
+  if(d > faultstat.max[id][cause])
+    faultstat.max[id][cause] = d;
+  pop_off();
+}
 
 #define RESIDENT 1
 #define SWAPPED 2
@@ -20,17 +46,21 @@ void
 lazy_init(struct proc *p)
 {
   // Initialize demand paging fields
-  p->text_start = 0;
-  p->text_end = 0;
-  p->data_start = 0;
-  p->data_end = 0;
-  p->heap_start = 0;
+  p->vm.n = 0;
   p->stack_top = 0;
   p->next_fifo_seq = 0;
   p->swapfile_inode = 0;
   p->num_swapped_pages = 0;
   p->num_pages = 0;
   p->exec_inode = 0;
+  p->suspended = 0;
+  p->parked = 0;
+  p->evicting = 0;
+  p->win_faults = 0;
+  p->pf_last = 0;
+  p->pf_stride = 0;
+  p->pf_window = 0;
+  p->pf_wcount = 0;
   
   for(int i = 0; i < 32; i++) {
     p->swap_slot_bitmap[i] = 0;
@@ -42,6 +72,7 @@ lazy_init(struct proc *p)
     p->pages[i].is_dirty = 0;
     p->pages[i].seq = 0;
     p->pages[i].swap_slot = -1;
+    p->pages[i].zslot = -1;
   }
 }
 
@@ -73,8 +104,95 @@ lazy_free(struct proc *p)
   
   // Log cleanup
   if(p->num_swapped_pages > 0) {
-    printf("[pid %d] SWAPCLEANUP freed_slots=%d\n", p->pid, p->num_swapped_pages);
+    trace(TR_SWAPCLEANUP, p->pid, p->num_swapped_pages, 0);
+  }
+}
+
+// Release p's pages in the compressed swap tier. Called with
+// the image they belong to gone.
+void
+lazy_zfree(struct proc *p)
+{
+  for(int i = 0; i < MAX_PROC_PAGES; i++) {
+    if(p->pages[i].state == SWAPPED && p->pages[i].zslot >= 0) {
+      zswapfree(p->pages[i].zslot);
+      p->pages[i].zslot = -1;
+      p->pages[i].state = UNMAPPED;
+    }
+  }
+}
+
+// Forget every page p tracks, giving back their swap slots and
+// compressed copies. exec calls this once the old image is gone,
+// so that none of its pages can be mistaken for the new one's.
+void
+lazy_reset(struct proc *p)
+{
+  struct page_info *pi;
+
+  for(pi = p->pages; pi < &p->pages[MAX_PROC_PAGES]; pi++) {
+    if(pi->swap_slot >= 0) {
+      free_swap_slot(p, pi->swap_slot);
+      p->num_swapped_pages--;
+    }
+    if(pi->zslot >= 0)
+      zswapfree(pi->zslot);
+    pi->va = 0;
+    pi->state = UNMAPPED;
+    pi->is_dirty = 0;
+    pi->seq = 0;
+    pi->swap_slot = -1;
+    pi->zslot = -1;
   }
+  p->num_pages = 0;
+  p->pf_window = 0;
+  p->pf_wcount = 0;
+}
+
+// Give the child np of fork the page info of its parent p. The
+// swap slots and compressed copies stay p's, so each page p has
+// out in either is read back into a frame of np's own and mapped
+// there, and a resident page that had a swap copy becomes dirty
+// in np. Called after uvmcopy(), without np->lock, since reading
+// the swap file sleeps. Returns -1 if out of memory.
+int
+lazy_fork(struct proc *p, struct proc *np)
+{
+  struct page_info *pi, *npi;
+  struct vma *v;
+  char *mem;
+
+  np->next_fifo_seq = p->next_fifo_seq;
+  np->num_pages = p->num_pages;
+  for(pi = p->pages, npi = np->pages; pi < &p->pages[MAX_PROC_PAGES]; pi++, npi++) {
+    *npi = *pi;
+    npi->swap_slot = -1;
+    npi->zslot = -1;
+    if(pi->state == RESIDENT && pi->swap_slot >= 0)
+      npi->is_dirty = 1;
+    if(pi->state != SWAPPED)
+      continue;
+
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(pi->zslot >= 0) {
+      zswapread(pi->zslot, mem);
+    } else if(p->swapfile_inode && pi->swap_slot >= 0) {
+      ilock(p->swapfile_inode);
+      readi(p->swapfile_inode, 0, (uint64)mem, (uint64)pi->swap_slot * PGSIZE, PGSIZE);
+      iunlock(p->swapfile_inode);
+    }
+    v = vmalookup(p, pi->va);
+    if(mappages(np->pagetable, pi->va, PGSIZE, (uint64)mem, PTE_U | (v ? v->prot : PTE_R | PTE_W)) != 0) {
+      kfree(mem);
+      return -1;
+    }
+    npi->state = RESIDENT;
+    npi->is_dirty = 1;
+    npi->seq = np->next_fifo_seq++;
+  }
+  return 0;
 }
 
 struct page_info*
@@ -86,152 +204,374 @@ get_page_info(struct proc *p, uint64 va)
   return &p->pages[page_num];
 }
 
+// Allocate a page for a fault, evicting to make room if need be.
+// Returns 0 and kills p if there is no memory at all.
+static char*
+lazy_kalloc(struct proc *p)
+{
+  char *mem;
+
+  if((mem = kalloc()) != 0)
+    return mem;
+  // Try to evict a page to make room, preferring
+  // pages of processes suspended by load control
+  if(thrash_reclaim() > 0 || lazy_evict_page(p) > 0)
+    mem = kalloc();
+  if(mem == 0){
+    trace(TR_MEMFULL, p->pid, 0, 0);
+    setkilled(p);
+  }
+  return mem;
+}
+
+// A write to a copy-on-write page: the shared zero page, or a
+// page merged by ksm.c. Give p a private copy, writable, unless
+// it holds the only reference anyway. Returns 0 if va was such a
+// page, -1 otherwise, or if its area isn't writable.
+static int
+lazy_cow(struct proc *p, uint64 va)
+{
+  struct vma *v;
+  pte_t *pte;
+  char *mem;
+  uint64 pa;
+
+  pte = walk(p->pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_COW) == 0)
+    return -1;
+  if((v = vmalookup(p, va)) == 0 || (v->prot & PTE_W) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  if(pa != (uint64)zeropage && krefcnt((void*)pa) == 2)
+    ksmdrop((char*)pa);
+  if(pa != (uint64)zeropage && ksmclaim(pte, (char*)pa)){
+    uvmfence(p, va);
+    return 0;
+  }
+  if((mem = lazy_kalloc(p)) == 0)
+    return -1;
+  // making room may have evicted this very page, in which
+  // case the retried access faults it in again.
+  pte = walk(p->pagetable, va, 0);
+  if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_COW) == 0 || PTE2PA(*pte) != pa){
+    kfree(mem);
+    return 0;
+  }
+  if(pa == (uint64)zeropage){
+    memset(mem, 0, PGSIZE);
+    VMSTAT_INC(zerocopies);
+    trace(TR_ZEROCOPY, p->pid, va, 0);
+  } else {
+    memmove(mem, (char*)pa, PGSIZE);
+    VMSTAT_INC(cowcopies);
+    __sync_fetch_and_sub(&vmstat.ksm_saved, 1);
+  }
+  *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  uvmfence(p, va);
+  kfree((void*)pa);
+  return 0;
+}
+
+// Bring back pi's page at va from the compressed tier or the
+// swap file into the free page mem, and map it. Returns 1 if it
+// came from the compressed tier, 0 if from the swap file, or -1
+// (with mem freed) if it couldn't be mapped.
+static int
+lazy_swapin(struct proc *p, struct page_info *pi, uint64 va, char *mem)
+{
+  memset(mem, 0, PGSIZE);
+  
+  // Restore from the compressed tier, or from swap
+  int zswapped = pi->zslot >= 0;
+  if(zswapped) {
+    trace(TR_ZLOAD, p->pid, va, pi->zslot);
+    zswapload(pi->zslot, mem);
+    pi->zslot = -1;
+  } else if(p->swapfile_inode && pi->swap_slot >= 0) {
+    uint64 t0 = r_time();
+    ilock(p->swapfile_inode);
+    readi(p->swapfile_inode, 0, (uint64)mem, (uint64)pi->swap_slot * PGSIZE, PGSIZE);
+    iunlock(p->swapfile_inode);
+    thrash_io(t0);
+    
+    VMSTAT_INC(swapins);
+    trace(TR_SWAPIN, p->pid, va, pi->swap_slot);
+  }
+  
+  // Permissions are those of its area
+  struct vma *v = vmalookup(p, va);
+  int pte_flags = PTE_U | (v ? v->prot : PTE_R | PTE_W);
+  
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, pte_flags) != 0) {
+    kfree(mem);
+    return -1;
+  }
+  
+  uvmfence(p, va);
+
+  // Update page state. The swap slot stays allocated: while
+  // the page is clean (PTE_D clear), the copy there is good,
+  // and evicting the page again needs no write. A compressed
+  // copy is freed as it is read, so such a page is dirty.
+  pi->state = RESIDENT;
+  pi->is_dirty = zswapped;
+  pi->seq = p->next_fifo_seq++;
+  
+  trace(TR_RESIDENT, p->pid, va, pi->seq);
+  return zswapped;
+}
+
+// Fault-address prediction. A process that walks through its
+// heap or stack, or back through pages it had swapped out, faults
+// at a constant stride. Once two faults in a row are the same
+// stride apart, each fault also pre-maps the next pf_window pages
+// along the stride: zero-filled, or read back from swap. The
+// window doubles (up to PFMAX) each time the next fault lands
+// just past it, and drops to nothing when one doesn't.
+//
+// Pre-mapped pages get no PTE_A from us, so when the next fault
+// comes, the hardware's PTE_A on them tells which of them were
+// used (vmstat pf_used and pf_wasted).
+#define PFMIN       2
+#define PFMAX       16
+#define PFMAXSTRIDE (16*PGSIZE)
+
+// Pre-map p's page at va as a fault there would, but without
+// evicting anything; write says the fault that predicted it was
+// a write. Returns 0, or -1 to stop the window.
+static int
+lazy_prefetch(struct proc *p, uint64 va, int write)
+{
+  struct page_info *pi = get_page_info(p, va);
+  struct vma *v;
+  char *mem;
+
+  if(pi == 0 || va >= MAXVA || ismapped(p->pagetable, va))
+    return -1;
+  if(va >= p->stack_top) {
+    // heap grown by sbrk(), which vmfault() fills untracked,
+    // leaving whole superpages to it.
+    uint64 sva = SUPERPGROUNDDOWN(va);
+    if(va >= p->sz || (sva >= p->stack_top && sva + SUPERPGSIZE <= p->sz))
+      return -1;
+    // a read scan gets the shared zero page, as vmfault() does.
+    if(!write) {
+      if(mappages(p->pagetable, va, PGSIZE, (uint64)zeropage, PTE_U | PTE_R | PTE_COW) != 0)
+        return -1;
+      uvmfence(p, va);
+      trace(TR_PREFETCH, p->pid, va, 0);
+      return 0;
+    }
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_U | PTE_R | PTE_W) != 0) {
+      kfree(mem);
+      return -1;
+    }
+    uvmfence(p, va);
+    trace(TR_PREFETCH, p->pid, va, 0);
+    return 0;
+  }
+  if(pi->state == SWAPPED) {
+    if(pi->va != va || (mem = kalloc()) == 0)
+      return -1;
+    return lazy_swapin(p, pi, va, mem) < 0 ? -1 : 0;
+  }
+  if(pi->state != UNMAPPED || (v = vmalookup(p, va)) == 0 || v->type != VMA_STACK)
+    return -1;
+  if(pi->swap_slot >= 0) {
+    free_swap_slot(p, pi->swap_slot);
+    p->num_swapped_pages--;
+    pi->swap_slot = -1;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_U | v->prot) != 0) {
+    kfree(mem);
+    return -1;
+  }
+  uvmfence(p, va);
+  pi->va = va;
+  pi->state = RESIDENT;
+  pi->is_dirty = 0;
+  pi->seq = p->next_fifo_seq++;
+  trace(TR_PREFETCH, p->pid, va, 0);
+  return 0;
+}
+
+// Called after an anonymous or swap fault at va has been handled;
+// write says whether it was a write fault.
+void
+lazy_predict(struct proc *p, uint64 va, int write)
+{
+  uint64 stride = va - p->pf_last;
+  pte_t *pte;
+  int i, n;
+
+  // score the last window.
+  for(i = 0; i < p->pf_wcount; i++) {
+    pte = walk(p->pagetable, p->pf_wbase + i * p->pf_stride, 0);
+    if(pte && (*pte & PTE_V) && (*pte & PTE_A))
+      VMSTAT_INC(pf_used);
+    else
+      VMSTAT_INC(pf_wasted);
+  }
+  p->pf_wcount = 0;
+
+  if(stride != 0 && stride == p->pf_stride &&
+     stride + PFMAXSTRIDE <= 2 * PFMAXSTRIDE) {
+    if(p->pf_window) {
+      VMSTAT_INC(pf_hits);
+      p->pf_window = p->pf_window * 2 > PFMAX ? PFMAX : p->pf_window * 2;
+    } else {
+      p->pf_window = PFMIN;
+    }
+  } else {
+    if(p->pf_window)
+      VMSTAT_INC(pf_misses);
+    p->pf_window = 0;
+    p->pf_stride = stride;
+  }
+  p->pf_last = va;
+  if(p->pf_window == 0)
+    return;
+
+  for(n = 0; n < p->pf_window; n++)
+    if(lazy_prefetch(p, va + (n + 1) * stride, write) < 0)
+      break;
+  if(n > 0) {
+    __sync_fetch_and_add(&vmstat.pf_pages, n);
+    p->pf_wbase = va + stride;
+    p->pf_wcount = n;
+    // the next fault in the run will be just past the window.
+    p->pf_last = va + n * stride;
+  }
+}
+
 int
 lazy_handle_fault(struct proc *p, uint64 va, int write_fault)
 {
+  uint64 start = r_time();
   va = PGROUNDDOWN(va);
-  const char *access_type = write_fault ? "write" : "read";
+  int access = write_fault ? TRF_WRITE : 0;
   
-  // If page is already mapped, let vmfault handle it
+  // If page is already mapped, let vmfault handle it,
+  // unless this is a write to the shared zero page.
   if(ismapped(p->pagetable, va)) {
+    if(write_fault)
+      return lazy_cow(p, va);
     return -1;
   }
   
   // Check if page is swapped - need to restore it
   struct page_info *pi_swap = get_page_info(p, va);
-  if(pi_swap && pi_swap->state == SWAPPED) {
-    printf("[pid %d] PAGEFAULT va=0x%lx access=%s cause=swap\n", p->pid, va, access_type);
+  if(pi_swap && pi_swap->state == SWAPPED && pi_swap->va == va) {
+    trace(TR_FAULT, p->pid, va, TRF_SWAP | access);
+    VMSTAT_INC(faults_swap);
+    thrash_fault(p);
     
     // Allocate physical page for restoration
-    uint64 mem = (uint64)kalloc();
-    if(mem == 0) {
-      // Try to evict a page to make room
-      if(lazy_evict_page(p) > 0) {
-        mem = (uint64)kalloc();
-      }
-      
-      if(mem == 0) {
-        printf("[pid %d] MEMFULL\n", p->pid);
-        setkilled(p);
-        return -1;
-      }
-    }
-    
-    memset((void *)mem, 0, PGSIZE);
-    
-    // Restore from swap
-    if(p->swapfile_inode && pi_swap->swap_slot >= 0) {
-      ilock(p->swapfile_inode);
-      readi(p->swapfile_inode, 0, mem, (uint64)pi_swap->swap_slot * PGSIZE, PGSIZE);
-      iunlock(p->swapfile_inode);
-      
-      printf("[pid %d] SWAPIN va=0x%lx slot=%d\n", p->pid, va, pi_swap->swap_slot);
-    }
-    
-    // Set permissions based on segment type
-    int pte_flags = PTE_U | PTE_R;
-    if(va >= p->text_start && va < p->text_end) {
-      // Text: executable, read-only
-      pte_flags |= PTE_X;
-    } else {
-      // Data/heap/stack: read-write
-      pte_flags |= PTE_W;
-    }
+    char *mem = lazy_kalloc(p);
+    if(mem == 0)
+      return -1;
     
-    if(mappages(p->pagetable, va, PGSIZE, mem, pte_flags) != 0) {
-      kfree((void *)mem);
+    int zswapped = lazy_swapin(p, pi_swap, va, mem);
+    if(zswapped < 0) {
       setkilled(p);
       return -1;
     }
+    lazy_predict(p, va, write_fault);
     
-    // Update page state
-    pi_swap->state = RESIDENT;
-    pi_swap->seq = p->next_fifo_seq++;
-    int old_slot = pi_swap->swap_slot;
-    pi_swap->swap_slot = -1;
-    
-    // Free the swap slot
-    if(old_slot >= 0) {
-      free_swap_slot(p, old_slot);
-      p->num_swapped_pages--;
-    }
-    
-    printf("[pid %d] RESIDENT va=0x%lx seq=%d\n", p->pid, va, pi_swap->seq);
-    
+    faultlat(zswapped ? FL_ZSWAP : FL_SWAP, start);
     return 0;
   }
   
-  printf("[pid %d] PAGEFAULT va=0x%lx access=%s epc=0x%lx cause=", p->pid, va, access_type, p->trapframe->epc);
-  
-  int valid = 0;
-  const char *cause = "unknown";
-  
-  // Check if access is valid
-  // Stack region is between p->sz - (USERSTACK+1)*PGSIZE and p->stack_top
-  uint64 stack_bottom = p->stack_top - (USERSTACK+1)*PGSIZE;
-  if(va >= stack_bottom && va < p->stack_top) {
-    valid = 1; 
-    cause = "stack";
-  } else if(va >= p->heap_start && va < stack_bottom) {
-    valid = 1; 
-    cause = "heap";
-  } else if((va >= p->text_start && va < p->text_end) ||
-            (va >= p->data_start && va < p->data_end)) {
-    valid = 1; 
-    cause = "exec";
-  }
+  // Classify the fault by the area it is in. The sbrk() heap is
+  // left to vmfault().
+  struct vma *v = vmalookup(p, va);
+  int cause = TRF_INVALID;
+  if(v && v->type == VMA_HEAP)
+    return -1;
+  if(v && v->type == VMA_STACK)
+    cause = TRF_STACK;
+  else if(v)
+    cause = TRF_EXEC;
   
-  if(!valid) {
-    printf("invalid\n");
+  trace(TR_FAULT, p->pid, va, cause | access);
+
+  if(v == 0) {
     // Don't kill process here - let caller decide
     // When called from copyin/copyout, we just want to fail the syscall
     // When called from trap handler, the trap handler will kill the process
     return -1;
   }
   
-  printf("%s\n", cause);
+  if(cause == TRF_STACK)
+    VMSTAT_INC(faults_stack);
+  else
+    VMSTAT_INC(faults_exec);
+  thrash_fault(p);
   
-  // Allocate physical page, with eviction if needed
-  uint64 mem = (uint64)kalloc();
-  if(mem == 0) {
-    // Try to evict a page to make room
-    if(lazy_evict_page(p) > 0) {
-      // Retry allocation after eviction
-      mem = (uint64)kalloc();
-    }
-    
-    if(mem == 0) {
-      printf("[pid %d] MEMFULL\n", p->pid);
+  // A read of a bss page that was never written maps the
+  // shared zero page read-only; a later write fault gives it
+  // a frame of its own.
+  struct page_info *pi = get_page_info(p, va);
+  // a swapped-out page that shares the slot keeps it, and
+  // this one goes untracked.
+  if(pi && pi->state == SWAPPED && pi->va != va)
+    pi = 0;
+  // the slot may still hold the swap copy of a page
+  // it tracked before.
+  if(pi && pi->swap_slot >= 0 && pi->state != SWAPPED) {
+    free_swap_slot(p, pi->swap_slot);
+    p->num_swapped_pages--;
+    pi->swap_slot = -1;
+  }
+  if(pi && pi->zslot >= 0) {
+    zswapfree(pi->zslot);
+    pi->zslot = -1;
+  }
+  if(!write_fault && pi && v->type == VMA_DATA && va - v->start >= v->filesz) {
+    // copy-on-write only if the area may be written at all.
+    int zflags = PTE_U | (v->prot & ~PTE_W) | ((v->prot & PTE_W) ? PTE_COW : 0);
+    if(mappages(p->pagetable, va, PGSIZE, (uint64)zeropage, zflags) != 0) {
       setkilled(p);
       return -1;
     }
+    uvmfence(p, va);
+    pi->va = va;
+    pi->state = RESIDENT;
+    pi->is_dirty = 0;
+    pi->seq = p->next_fifo_seq++;
+    VMSTAT_INC(zeromaps);
+    trace(TR_ZEROMAP, p->pid, va, 0);
+    faultlat(FL_EXEC, start);
+    return 0;
   }
   
+  // Allocate physical page, with eviction if needed
+  uint64 mem = (uint64)lazy_kalloc(p);
+  if(mem == 0)
+    return -1;
+  
   memset((void *)mem, 0, PGSIZE);
   
-  // Load from executable if this is an exec segment
-  if(cause[0] == 'e' && p->exec_inode) {
-    int page_idx = (va / PGSIZE) % MAX_PROC_PAGES;
-    uint64 file_offset = (page_idx < MAX_PROC_PAGES) ? p->exec_off[page_idx] : 0;
-    int read_len = (page_idx < MAX_PROC_PAGES) ? p->exec_len[page_idx] : 0;
-    
-    if(file_offset > 0 && read_len > 0) {
-      ilock(p->exec_inode);
-      readi(p->exec_inode, 0, mem, file_offset, read_len);
-      iunlock(p->exec_inode);
-      // Rest of page already zeroed by memset above
-    }
+  // Load the part of the page the area's file backs
+  uint64 page_off = va - v->start;
+  if(v->ip && page_off < v->filesz) {
+    uint64 read_len = v->filesz - page_off;
+    if(read_len > PGSIZE)
+      read_len = PGSIZE;
+    ilock(v->ip);
+    readi(v->ip, 0, mem, v->off + page_off, read_len);
+    iunlock(v->ip);
+    // Rest of page already zeroed by memset above
   }
   
-  // Set appropriate permissions by region
-  int pte_flags = PTE_U | PTE_R;
-  if(va >= p->text_start && va < p->text_end) {
-    // Text: RX only
-    pte_flags |= PTE_X;
-  } else {
-    // Data/heap/stack: RW
-    pte_flags |= PTE_W;
-  }
+  // Permissions are those of its area
+  int pte_flags = PTE_U | v->prot;
   
   if(mappages(p->pagetable, va, PGSIZE, mem, pte_flags) != 0) {
     kfree((void *)mem);
@@ -239,25 +579,29 @@ lazy_handle_fault(struct proc *p, uint64 va, int write_fault)
     return -1;
   }
   
+  uvmfence(p, va);
+
   // Log allocation
-  if(cause[0] == 'e') {
-    printf("[pid %d] LOADEXEC va=0x%lx\n", p->pid, va);
+  if(cause == TRF_EXEC) {
+    trace(TR_LOADEXEC, p->pid, va, 0);
   } else {
-    printf("[pid %d] ALLOC va=0x%lx\n", p->pid, va);
+    trace(TR_ALLOC, p->pid, va, 0);
   }
   
   // Update page info
-  struct page_info *pi = get_page_info(p, va);
   if(pi) {
     pi->va = va;
     pi->state = RESIDENT;
-    pi->is_dirty = write_fault ? 1 : 0;  // Mark as dirty if write fault
+    pi->is_dirty = 0;  // the hardware sets PTE_D on the first write
     pi->seq = p->next_fifo_seq++;
     pi->swap_slot = -1;
     
-    printf("[pid %d] RESIDENT va=0x%lx seq=%d\n", p->pid, va, pi->seq);
+    trace(TR_RESIDENT, p->pid, va, pi->seq);
   }
+  if(cause == TRF_STACK)
+    lazy_predict(p, va, write_fault);
   
+  faultlat(cause == TRF_STACK ? FL_STACK : FL_EXEC, start);
   return 0;
 }
 
@@ -406,55 +750,196 @@ lazy_evict_page(struct proc *p)
   
   uint64 victim_va = p->pages[victim_idx].va;
   
-  printf("[pid %d] VICTIM va=0x%lx seq=%d\n", p->pid, victim_va, p->pages[victim_idx].seq);
-  
-  // Check if page is dirty (tracked in page_info)
-  int is_dirty = p->pages[victim_idx].is_dirty;
-  
-  // Check if it's an executable page (has file backing)
-  int is_executable = (victim_va >= p->text_start && victim_va < p->text_end);
-  
-  if(is_dirty || !is_executable) {
+  trace(TR_VICTIM, p->pid, victim_va, p->pages[victim_idx].seq);
+  
+  // The page's backing copy is its swap slot if it has one, and
+  // otherwise what a fresh fault would produce: the executable's
+  // contents for text and data, zeros for heap and stack. The
+  // hardware sets PTE_D on any write since the page was mapped,
+  // so the page matches its backing exactly when PTE_D is clear.
+  struct page_info *pi = &p->pages[victim_idx];
+  pte_t *pte = walk(p->pagetable, victim_va, 0);
+  uint64 pa = walkaddr(p->pagetable, victim_va);
+  int z;
+  if(pte && (*pte & PTE_V) && (*pte & PTE_D))
+    pi->is_dirty = 1;
+  // writei() may sleep, and ksm.c may merge the page and free
+  // its frame meanwhile; hold on to it until we're done.
+  if(pa && pa != (uint64)zeropage)
+    kref((void*)pa);
+  
+  if(!pi->is_dirty && pi->swap_slot >= 0) {
+    // Clean, and the copy in swap is good.
+    VMSTAT_INC(discards);
+    trace(TR_DISCARD, p->pid, victim_va, pi->swap_slot);
+    pi->state = SWAPPED;
+  } else if(!pi->is_dirty) {
+    // Clean; a fault will rebuild it.
+    VMSTAT_INC(discards);
+    trace(TR_DISCARD, p->pid, victim_va, 0);
+    pi->state = UNMAPPED;
+  } else if(pa && (z = zswapstore((char *)pa)) >= 0) {
+    // Compressed into RAM. Any copy in swap is stale now.
+    if(pi->swap_slot >= 0) {
+      free_swap_slot(p, pi->swap_slot);
+      p->num_swapped_pages--;
+      pi->swap_slot = -1;
+    }
+    trace(TR_ZSTORE, p->pid, victim_va, z);
+    pi->state = SWAPPED;
+    pi->zslot = z;
+    pi->is_dirty = 0;
+  } else {
     // Need to write to swap
     if(p->swapfile_inode == 0) {
       if(create_swap_file(p) != 0) {
-        printf("[pid %d] KILL swap-exhausted\n", p->pid);
+        trace(TR_KILL, p->pid, victim_va, TRK_SWAPFULL);
         setkilled(p);
+        if(pa)
+          kfree((void*)pa);
         return -1;
       }
     }
     
-    int slot = alloc_swap_slot(p);
-    if(slot < 0) {
-      printf("[pid %d] KILL swap-exhausted\n", p->pid);
+    // reuse the page's old slot, if it has one.
+    int slot = pi->swap_slot;
+    if(slot < 0 && (slot = alloc_swap_slot(p)) < 0) {
+      trace(TR_KILL, p->pid, victim_va, TRK_SWAPFULL);
       setkilled(p);
+      if(pa)
+        kfree((void*)pa);
       return -1;
     }
     
     // Write page to swap
-    uint64 pa = walkaddr(p->pagetable, victim_va);
     if(pa) {
+      uint64 t0 = r_time();
       ilock(p->swapfile_inode);
       writei(p->swapfile_inode, 0, pa, (uint64)slot * PGSIZE, PGSIZE);
       iunlock(p->swapfile_inode);
+      thrash_io(t0);
       
-      printf("[pid %d] SWAPOUT va=0x%lx slot=%d\n", p->pid, victim_va, slot);
+      VMSTAT_INC(swapouts);
+      trace(TR_SWAPOUT, p->pid, victim_va, slot);
     }
     
-    p->pages[victim_idx].state = SWAPPED;
-    p->pages[victim_idx].swap_slot = slot;
-    p->num_swapped_pages++;
-  } else {
-    // Executable page with no writes - can just discard
-    printf("[pid %d] DISCARD va=0x%lx\n", p->pid, victim_va);
-    p->pages[victim_idx].state = UNMAPPED;
-    p->pages[victim_idx].swap_slot = -1;
+    if(pi->swap_slot < 0)
+      p->num_swapped_pages++;
+    pi->state = SWAPPED;
+    pi->swap_slot = slot;
+    pi->is_dirty = 0;
   }
   
-  // Unmap the page using uvmunmap
-  uvmunmap(p->pagetable, victim_va, PGSIZE, 1);
+  // Unmap just this page; uvmunmap demotes its superpage,
+  // if it is in one
+  uvmunmap(p->pagetable, victim_va, 1, 1);
+  uvmfence(p, victim_va);
+  if(pa)
+    kfree((void*)pa);
   
-  printf("[pid %d] EVICT va=0x%lx\n", p->pid, victim_va);
+  VMSTAT_INC(evictions);
+  trace(TR_EVICT, p->pid, victim_va, 0);
   
   return 1; // Successfully evicted one page
 }
+
+// Pages lazy_pagestat() looks at per call, so that a sparse
+// address space doesn't keep interrupts off for long.
+#define PAGESTAT_SCAN 256
+
+// Fill buf with up to n entries for p's pages at or above *va, in
+// address order: pages that are mapped and pages that are swapped
+// out. Looks at no more than PAGESTAT_SCAN pages. Sets *va to
+// where the next call should start. Returns the number of entries.
+int
+lazy_pagestat(struct proc *p, uint64 *va, struct page_stat *buf, int n)
+{
+  struct page_info *pi;
+  pte_t *pte;
+  uint64 a, end;
+  int k = 0;
+
+  a = PGROUNDDOWN(*va);
+  end = a + PAGESTAT_SCAN * PGSIZE;
+  for(; a < p->sz && a < MAXVA && a < end && k < n; a += PGSIZE){
+    pi = get_page_info(p, a);
+    if(pi && (pi->va != a || pi->state == UNMAPPED))
+      pi = 0;  // the slot tracks some other page
+    pte = walk(p->pagetable, a, 0);
+    buf[k].is_dirty = pi ? pi->is_dirty : 0;
+    if(pte && (*pte & PTE_V)){
+      buf[k].state = RESIDENT;
+      buf[k].swap_slot = pi ? pi->swap_slot : -1;
+      buf[k].is_zero = PTE2PA(*pte) == (uint64)zeropage;
+      if(*pte & PTE_D)
+        buf[k].is_dirty = 1;
+    } else if(pi && pi->state == SWAPPED){
+      buf[k].state = SWAPPED;
+      buf[k].swap_slot = pi->swap_slot;
+      buf[k].is_zero = 0;
+    } else {
+      continue;
+    }
+    buf[k].va = a;
+    buf[k].seq = pi && pi->state == RESIDENT ? pi->seq : -1;
+    k++;
+  }
+  *va = a;
+  return k;
+}
+
+// Copy to user address addr up to n page_stat entries for the pages
+// of process pid (0 for the caller) at or above va. Returns the
+// number copied, or -1 if there is no such process. The caller
+// pages through the whole address space by starting the next call
+// just past the last entry it got.
+int
+memstat(int pid, uint64 va, uint64 addr, int n)
+{
+  struct page_stat buf[16];
+  struct proc *p;
+  int k, done, total = 0;
+
+  while(total < n){
+    for(p = proc; p < &proc[NPROC]; p++){
+      acquire(&p->lock);
+      if(p->state != UNUSED && p->state != ZOMBIE && p->pagetable &&
+         p->pid == (pid ? pid : myproc()->pid))
+        break;
+      release(&p->lock);
+    }
+    if(p == &proc[NPROC])
+      return total ? total : -1;
+    // p->lock keeps p from being freed meanwhile, and exec from
+    // freeing the page table we walk; exec swaps it under p->lock.
+    k = lazy_pagestat(p, &va, buf, n - total < NELEM(buf) ? n - total : NELEM(buf));
+    done = va >= p->sz || va >= MAXVA;
+    release(&p->lock);
+    if(k > 0 && either_copyout(1, addr + total * sizeof(buf[0]), buf, k * sizeof(buf[0])) < 0)
+      return -1;
+    total += k;
+    if(done)
+      break;
+  }
+  return total;
+}
+
+// Copy the fault latency histograms to user address addr.
+int
+faultstatout(uint64 addr)
+{
+  return either_copyout(1, addr, &faultstat, sizeof(faultstat));
+}
+
+// Snapshot the system-wide counters into st.
+void
+vmstatfill(struct vmstat *st)
+{
+  struct proc *p;
+
+  *st = vmstat;
+  st->freepages = kfreepages();
+  st->swapslots = 0;
+  for(p = proc; p < &proc[NPROC]; p++)
+    st->swapslots += p->num_swapped_pages;
+}
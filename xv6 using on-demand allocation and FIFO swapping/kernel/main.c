@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "defs.h"
+#include "memstat.h"
 
 volatile static int started = 0;
 
@@ -11,6 +12,7 @@ void
 main()
 {
   if(cpuid() == 0){
+    uint64 t0 = r_time();
     consoleinit();
     printfinit();
     printf("\n");
@@ -20,6 +22,8 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    traceinit();     // kernel trace buffer
+    thrashinit();    // paging load control
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
@@ -28,7 +32,11 @@ main()
     iinit();         // inode table
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
+    zswapinit();     // compressed swap tier
     userinit();      // first user process
+    ksminit();       // same-page merging thread
+    // the time CSR counts at 10 MHz under qemu.
+    vmstat.boot_us = (r_time() - t0) / 10;
     __sync_synchronize();
     started = 1;
   } else {
@@ -47,6 +47,12 @@
 // each surrounded by invalid guard pages.
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
 
+// with USERMAP, a process's kernel page table shows user
+// addresses [0, UWINSIZE) again at UWINBASE. both must be
+// multiples of the 1GB covered by one root PTE.
+#define UWINBASE (1L << 37)
+#define UWINSIZE (1L << 36)
+
 // User memory layout.
 // Address zero first:
 //   text
@@ -4,29 +4,76 @@
 #define _MEMSTAT_H_
 
 #include "types.h"
-
-#define MAX_PAGES_INFO 128 // Max pages to report per syscall
+#include "param.h"
 
 // Page states
 #define UNMAPPED 0 
 #define RESIDENT 1 
 #define SWAPPED  2
 
+// One page of a process, as reported by memstat().
 struct page_stat {
-  uint va;       // Virtual address of the page (page-aligned)
-  int state;     // Page state: UNMAPPED, RESIDENT, or SWAPPED
+  uint64 va;     // Virtual address of the page (page-aligned)
+  int state;     // Page state: RESIDENT or SWAPPED
   int is_dirty;  // 1 if page has been written to, 0 otherwise
-  int seq;       // FIFO sequence number (for resident pages)
-  int swap_slot; // Swap slot number (for swapped pages, -1 otherwise)
+  int seq;       // FIFO sequence number (for tracked resident pages, -1 otherwise)
+  int swap_slot; // Swap slot holding a copy of the page, or -1
+  int is_zero;   // 1 if mapped to the shared zero page
+};
+
+// System-wide paging counters, as reported by vmstat().
+// Counts are since boot.
+struct vmstat {
+  uint64 faults_stack;    // stack pages zero-filled
+  uint64 faults_heap;     // heap pages zero-filled
+  uint64 faults_exec;     // text/data pages loaded from the executable
+  uint64 faults_swap;     // pages brought back from swap
+  uint64 faults_sbrk;     // pages of a lazy sbrk() zero-filled
+  uint64 faults_invalid;  // faults that killed the process
+  uint64 zeromaps;        // read faults given the shared zero page
+  uint64 zerocopies;      // writes that gave such a page its own frame
+  uint64 cowcopies;       // writes that gave a merged page its own frame
+  uint64 ksm_rate;        // pages the merging scanner looks at per tick, 0 if off
+  uint64 ksm_scanned;     // pages it has looked at
+  uint64 ksm_merged;      // pages it has merged into another page
+  uint64 ksm_saved;       // merged pages not yet copied again on write
+  uint64 zswap_on;        // 1 if evicted pages go to the compressed tier first
+  uint64 zswap_pool;      // frames reserved for it
+  uint64 zswap_pages;     // pages in it right now
+  uint64 zswap_bytes;     // their compressed size
+  uint64 zswap_stores;    // pages compressed into it
+  uint64 zswap_loads;     // pages decompressed from it
+  uint64 zswap_rejects;   // pages sent to disk as incompressible
+  uint64 zswap_full;      // pages sent to disk because it was full
+  uint64 pf_hits;         // faults where the stride predictor was right
+  uint64 pf_misses;       // faults where it was wrong, collapsing its window
+  uint64 pf_pages;        // pages it pre-mapped
+  uint64 pf_used;         // pre-mapped pages touched by the next fault
+  uint64 pf_wasted;       // pre-mapped pages not touched by then
+  uint64 swapins;         // pages read from swap
+  uint64 swapouts;        // pages written to swap
+  uint64 discards;        // clean pages dropped
+  uint64 evictions;       // pages evicted, swapped out or dropped
+  uint64 freepages;       // free physical pages right now
+  uint64 swapslots;       // swap slots in use right now
+  uint64 boot_us;         // main() to the first process, in microseconds
 };
 
-struct proc_mem_stat {
-  int pid;                                    // Process ID
-  int num_pages_total;                        // Total number of virtual pages
-  int num_resident_pages;                     // Number of pages currently in physical memory
-  int num_swapped_pages;                      // Number of pages currently swapped out
-  int next_fifo_seq;                          // Next FIFO sequence number to be assigned
-  struct page_stat pages[MAX_PAGES_INFO];    // Array of page information
+// Page-fault latency histograms, as reported by faultstat().
+// Latency is from entry to exit of the fault handler, in r_time()
+// units (100 ns on qemu). Bucket b counts faults that took
+// [2^b, 2^(b+1)) units; bucket 0 also counts 0.
+#define FL_STACK 0
+#define FL_HEAP  1
+#define FL_EXEC  2
+#define FL_SWAP  3   // from the swap file
+#define FL_ZSWAP 4   // from the compressed tier
+#define NFLCAUSE 5
+#define NFLBUCKET 32
+
+struct faultstat {
+  uint64 hist[NCPU][NFLCAUSE][NFLBUCKET];
+  uint64 max[NCPU][NFLCAUSE];   // slowest fault seen
 };
 
 #endif // _MEMSTAT_H_
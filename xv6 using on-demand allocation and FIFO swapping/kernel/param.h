@@ -13,3 +13,7 @@
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
 
+#define THRASH_WINDOW    10  // load control sampling window (ticks)
+#define THRASH_FAULTS_HI 64  // faults per window that suggest thrashing
+#define THRASH_FAULTS_LO 16  // faults per window below which to resume
+#define THRASH_IO_PCT    50  // % of a window in swap I/O that confirms it
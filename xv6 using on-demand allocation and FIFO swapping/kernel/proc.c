@@ -16,10 +16,112 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// Sleeping processes, on lists hashed by channel, so that
+// wakeup() looks only at the processes sleeping on channels in
+// one bucket instead of locking every process in the table. A
+// process is on its channel's list exactly while it is SLEEPING.
+// The bucket's lock protects the list and the chan fields of the
+// processes on it.
+// Lock order: a sleepq lock, then p->lock.
+#define SLEEPQ_BITS 6
+#define NSLEEPQ (1 << SLEEPQ_BITS)
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;      // linked through p->qnext
+} sleepq[NSLEEPQ];
+
+static struct sleepq*
+sleepq_of(void *chan)
+{
+  return &sleepq[((uint64)chan * 0x9E3779B97F4A7C15UL) >> (64 - SLEEPQ_BITS)];
+}
+
+// Runnable processes, on a FIFO list per hart, so that each hart
+// round-robins its own processes instead of every hart locking
+// every process in the table. New and preempted processes go on
+// the local list, and woken ones on the list of the hart they
+// last ran on. A hart with nothing queued steals from the longest
+// list. A process is on a list exactly while it is RUNNABLE.
+// Lock order: p->lock, then a runq lock; scheduler() takes a
+// process off its list before it locks the process.
+struct runq {
+  struct spinlock lock;
+  struct proc *head;      // linked through p->rqnext
+  struct proc *tail;
+  int n;
+} runq[NCPU];
+
+// Make p RUNNABLE and queue it on hart id's list.
+// Caller must hold p->lock.
+static void
+runqput(struct proc *p, int id)
+{
+  struct runq *rq = &runq[id];
+
+  p->state = RUNNABLE;
+  p->rqcpu = id;
+  p->rqnext = 0;
+  acquire(&rq->lock);
+  if(rq->tail)
+    rq->tail->rqnext = p;
+  else
+    rq->head = p;
+  rq->tail = p;
+  rq->n++;
+  release(&rq->lock);
+}
+
+// Make p RUNNABLE on this hart. Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  runqput(p, cpuid());
+}
+
+// Take the first process off hart id's list, or return 0.
+static struct proc*
+runqget(int id)
+{
+  struct runq *rq = &runq[id];
+  struct proc *p;
+
+  acquire(&rq->lock);
+  if((p = rq->head) != 0){
+    rq->head = p->rqnext;
+    if(rq->head == 0)
+      rq->tail = 0;
+    rq->n--;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Next process for hart id to run: its own first, else one
+// from the longest list. The lengths are read without locks,
+// so a steal may come up empty; the caller just tries again.
+static struct proc*
+runqpick(int id)
+{
+  struct proc *p;
+  int i, busiest;
+
+  if((p = runqget(id)) != 0)
+    return p;
+  busiest = -1;
+  for(i = 0; i < NCPU; i++)
+    if(i != id && runq[i].n > 0 && (busiest < 0 || runq[i].n > runq[busiest].n))
+      busiest = i;
+  if(busiest < 0)
+    return 0;
+  return runqget(busiest);
+}
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
@@ -51,6 +153,10 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -146,6 +252,20 @@ found:
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
 
+#ifdef USERMAP
+  // p's kernel page table, with a window onto its user memory.
+  if((p->kpagetable = uwinalloc()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+#endif
+
+  // A new address space; uvmsatp() assigns an ASID.
+  p->asid = 0;
+  p->lasthart = -1;
+  p->tlbflush = 0;
+
   // Initialize demand paging metadata
   demand_paging_init(p);
 
@@ -161,11 +281,15 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  if(p->kpagetable)
+    kfree((void*)p->kpagetable);
+  p->kpagetable = 0;
   
   // Do not perform filesystem operations here; freeproc is called with p->lock held.
   // Swap file and exec inode cleanup happens in kexit() before taking p->lock.
   p->swapfile_inode = 0;
   p->exec_inode = 0;
+  lazy_zfree(p);
   
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
@@ -174,6 +298,8 @@ freeproc(struct proc *p)
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
+  p->kthread = 0;
+  p->atuser = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
@@ -257,7 +383,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -279,6 +405,8 @@ growproc(int n)
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
+  // too many pages may have changed to fence one at a time.
+  p->tlbflush = 1;
   return 0;
 }
 
@@ -306,29 +434,22 @@ kfork(void)
   np->sz = p->sz;
   
   // Copy memory layout fields for demand paging
-  np->text_start = p->text_start;
-  np->text_end = p->text_end;
-  np->data_start = p->data_start;
-  np->data_end = p->data_end;
-  np->heap_start = p->heap_start;
+  np->vm = p->vm;
   np->stack_top = p->stack_top;
   
-  // Copy page_info array and other demand paging state
-  np->num_pages = p->num_pages;
-  np->next_fifo_seq = p->next_fifo_seq;
-  for(i = 0; i < p->num_pages; i++) {
-    np->pages[i] = p->pages[i];
+  // Copy page_info array, and the pages p has swapped out
+  release(&np->lock);
+  i = lazy_fork(p, np);
+  acquire(&np->lock);
+  if(i < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
   }
   
   // Duplicate exec_inode reference so child can fault in lazy pages
-  if(p->exec_inode) {
+  if(p->exec_inode)
     np->exec_inode = idup(p->exec_inode);
-    // Also copy exec_off and exec_len arrays
-    for(i = 0; i < MAX_PROC_PAGES; i++) {
-      np->exec_off[i] = p->exec_off[i];
-      np->exec_len[i] = p->exec_len[i];
-    }
-  }
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -353,7 +474,7 @@ kfork(void)
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -506,25 +627,36 @@ scheduler(void)
     intr_on();
     intr_off();
 
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
+    // Suspend or resume processes if paging pressure changed.
+    thrash_check();
+
+    if((p = runqpick(cpuid())) != 0) {
+      // A process that just yielded on another hart is queued
+      // before it is off that hart's stack; its p->lock is held
+      // until that hart's scheduler() is back, so wait on it.
       acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-        found = 1;
-      }
+      if(p->state != RUNNABLE)
+        panic("scheduler: queued process not runnable");
+
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->rqcpu = cpuid();
+      c->proc = p;
+#ifdef USERMAP
+      kvmswitch(p);
+      swtch(&c->context, &p->context);
+      kvmswitch(0);
+#else
+      swtch(&c->context, &p->context);
+#endif
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
       release(&p->lock);
-    }
-    if(found == 0) {
+    } else {
       // nothing to run; stop running on this core until an interrupt.
       asm volatile("wfi");
     }
@@ -564,11 +696,39 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
 
+// Start a kernel thread that runs fn, which must not return.
+// It is a process that never enters user space.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kthread = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  setrunnable(p);
+  release(&p->lock);
+}
+
+// A kernel thread's first scheduling swtches here.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kthread();
+  panic("kthread returned");
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -601,7 +761,7 @@ forkret(void)
 
   // return to user space, mimicing usertrap()'s return.
   prepare_return();
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = uvmsatp(p);
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
   ((void (*)(uint64))trampoline_userret)(satp);
 }
@@ -612,20 +772,26 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = sleepq_of(chan);
   
   // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // change p->state and then call sched,
+  // and chan's sleepq lock to go on its list.
+  // Once we hold the sleepq lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks it),
   // so it's okay to release lk.
 
+  acquire(&q->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->qnext = q->head;
+  q->head = p;
+  release(&q->lock);
 
   sched();
 
@@ -642,17 +808,41 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct sleepq *q = sleepq_of(chan);
+  struct proc *p, **pp;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  acquire(&q->lock);
+  for(pp = &q->head; (p = *pp) != 0; ){
+    if(p->chan == chan){
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
+      runqput(p, p->rqcpu);
       release(&p->lock);
+      *pp = p->qnext;
+    } else {
+      pp = &p->qnext;
     }
   }
+  release(&q->lock);
+}
+
+// Wake p if it is still asleep on a channel in chan's bucket.
+static void
+unsleep(struct proc *p, void *chan)
+{
+  struct sleepq *q = sleepq_of(chan);
+  struct proc **pp;
+
+  acquire(&q->lock);
+  for(pp = &q->head; *pp; pp = &(*pp)->qnext){
+    if(*pp == p){
+      acquire(&p->lock);
+      runqput(p, p->rqcpu);
+      release(&p->lock);
+      *pp = p->qnext;
+      break;
+    }
+  }
+  release(&q->lock);
 }
 
 // Kill the process with the given pid.
@@ -662,16 +852,19 @@ int
 kkill(int pid)
 {
   struct proc *p;
+  void *chan;
 
   for(p = proc; p < &proc[NPROC]; p++){
     acquire(&p->lock);
     if(p->pid == pid){
       p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
+      chan = p->state == SLEEPING ? p->chan : 0;
       release(&p->lock);
+      if(chan){
+        // Wake process from sleep(). That takes the
+        // sleepq lock, which comes before p->lock.
+        unsleep(p, chan);
+      }
       return 0;
     }
     release(&p->lock);
@@ -754,6 +947,9 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    if(p->suspended)
+      printf(" (suspended)");
     printf("\n");
   }
+  tracedump();
 }
@@ -27,6 +27,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation this TLB was last flushed for.
 };
 
 extern struct cpu cpus[NCPU];
@@ -91,9 +92,41 @@ enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 struct page_info {
   uint64 va;           // Virtual address (page-aligned)
   int state;           // UNMAPPED, RESIDENT, or SWAPPED
-  int is_dirty;        // 1 if written to since resident
+  int is_dirty;        // 1 if it differs from its backing copy; see lazy_evict_page()
   int seq;             // FIFO sequence number (for resident pages)
-  int swap_slot;       // Swap slot number (for swapped pages, -1 otherwise)
+  int swap_slot;       // Swap slot holding a copy of the page, or -1
+  int zslot;           // zswap.c entry holding it, if SWAPPED, or -1
+};
+
+// A range of the address space; see vma.c.
+#define NVMA 16
+
+#define VMA_TEXT  1  // read from ip, read-only
+#define VMA_DATA  2  // read from ip up to filesz, zero after (bss)
+#define VMA_STACK 3  // zero-filled
+#define VMA_HEAP  4  // zero-filled by vmfault(); ends at p->sz
+
+struct vma {
+  uint64 start;        // page-aligned
+  uint64 end;
+  int type;            // VMA_*
+  int prot;            // PTE_R, PTE_W, PTE_X
+  struct inode *ip;    // backing file, or 0
+  uint64 off;          // offset in ip of start
+  uint64 filesz;       // bytes of ip from off; the rest is zeros
+};
+
+struct vmamap {
+  int n;
+  struct vma vma[NVMA];  // sorted by start
+};
+
+// A pending wakeup on the timer wheel (timer.c).
+// tickslock must be held when using these.
+struct timer {
+  uint expires;                // ticks value to wake at
+  struct timer *next;
+  struct timer **pprev;        // 0 if not on the wheel
 };
 
 // Per-process state
@@ -102,18 +135,35 @@ struct proc {
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
-  void *chan;                  // If non-zero, sleeping on chan
+  void *chan;                  // If non-zero, sleeping on chan; see sleepq
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int atuser;                  // Preempted on the way back to user; see ksm.c
+
+  int rqcpu;                   // Hart whose runq it goes on when woken
+
+  // chan's sleepq lock must be held when using this:
+  struct proc *qnext;          // Next process sleeping in the bucket
+
+  // its runq's lock must be held when using this:
+  struct proc *rqnext;         // Next process on the hart's runq
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
 
+  // tickslock must be held when using this:
+  struct timer timer;          // For timer_sleep()
+
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table with user window (USERMAP)
+  void (*kthread)(void);       // Body, if this is a kernel thread
+  uint64 asid;                 // ASID generation and number; see uvmsatp()
+  int lasthart;                // Hart p last returned to user space on
+  int tlbflush;                // Flush p's ASID before next return to user
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
@@ -121,19 +171,24 @@ struct proc {
   char name[16];               // Process name (debugging)
   
   // Demand paging fields
-  uint64 text_start;           // Start of text segment
-  uint64 text_end;             // End of text segment
-  uint64 data_start;           // Start of data segment
-  uint64 data_end;             // End of data segment
-  uint64 heap_start;           // Start of heap
-  uint64 stack_top;            // Top of stack (highest valid stack address)
+  struct vmamap vm;            // Areas of the address space
+  uint64 stack_top;            // Top of stack; the sbrk() heap starts here
   int next_fifo_seq;           // Next FIFO sequence number to assign
   struct inode *swapfile_inode;  // Swap file inode for this process
   int swap_slot_bitmap[32];    // Bitmap for 1024 swap slots (1024/32 = 32 ints)
   int num_swapped_pages;       // Count of pages currently swapped
   struct page_info pages[MAX_PROC_PAGES]; // Per-page information
   int num_pages;               // Number of pages tracked
-  struct inode *exec_inode;    // Executable file inode (for demand loading)
-  uint64 exec_off[MAX_PROC_PAGES];  // File offsets for executable pages
-  int exec_len[MAX_PROC_PAGES];     // Number of bytes to read (rest is BSS)
+  struct inode *exec_inode;    // Executable file inode, backing text and data
+
+  // Load control (thrash.c); lc.lock must be held for these:
+  int suspended;               // Load control has taken us off the CPU
+  int parked;                  // Suspended and waiting in thrash_park()
+  int evicting;                // Another process is reclaiming our pages
+  uint64 win_faults;           // Paging faults in this load-control window
+  uint64 pf_last;              // Fault predictor: last fault address,
+  uint64 pf_stride;            //   stride to it from the one before,
+  int pf_window;               //   pages to pre-map on the next hit,
+  uint64 pf_wbase;             //   and the pages pre-mapped last time;
+  int pf_wcount;               //   see lazy_predict()
 };
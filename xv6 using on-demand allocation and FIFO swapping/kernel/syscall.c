@@ -102,6 +102,12 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern uint64 sys_memstat(void);
+extern uint64 sys_traceread(void);
+extern uint64 sys_traceecho(void);
+extern uint64 sys_vmstat(void);
+extern uint64 sys_faultstat(void);
+extern uint64 sys_ksm(void);
+extern uint64 sys_zswap(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -128,6 +134,12 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_memstat] sys_memstat,
+[SYS_traceread] sys_traceread,
+[SYS_traceecho] sys_traceecho,
+[SYS_vmstat]  sys_vmstat,
+[SYS_faultstat] sys_faultstat,
+[SYS_ksm]     sys_ksm,
+[SYS_zswap]   sys_zswap,
 };
 
 void
@@ -21,3 +21,9 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_memstat 22
+#define SYS_traceread 23
+#define SYS_traceecho 24
+#define SYS_vmstat 25
+#define SYS_faultstat 26
+#define SYS_ksm    27
+#define SYS_zswap  28
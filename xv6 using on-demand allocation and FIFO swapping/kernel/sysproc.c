@@ -66,22 +66,11 @@ uint64
 sys_pause(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return timer_sleep(n);
 }
 
 uint64
@@ -107,55 +96,94 @@ sys_uptime(void)
 }
 
 // Get memory statistics for the current process
+// copy out up to n page_stat entries for the pages of
+// process pid (0 for the caller) at or above start_va.
 uint64
 sys_memstat(void)
+{
+  int pid, n;
+  uint64 va, addr;
+
+  argint(0, &pid);
+  argaddr(1, &va);
+  argaddr(2, &addr);
+  argint(3, &n);
+  if(n < 0)
+    return -1;
+  return memstat(pid, va, addr, n);
+}
+
+// copy out the system-wide paging counters.
+uint64
+sys_vmstat(void)
 {
   uint64 addr;
-  struct proc *p = myproc();
-  struct proc_mem_stat info;
-  
+  struct vmstat st;
+
   argaddr(0, &addr);
-  
-  // Fill in the memory statistics
-  info.pid = p->pid;
-  info.next_fifo_seq = p->next_fifo_seq;
-  
-  // Count pages by state
-  int num_resident = 0;
-  int num_swapped = 0;
-  int num_total = 0;
-  
-  // Calculate total number of virtual pages
-  uint64 total_va_space = p->sz;
-  num_total = total_va_space / PGSIZE;
-  if(total_va_space % PGSIZE != 0)
-    num_total++;
-  
-  // Count by examining page info
-  for(int i = 0; i < p->num_pages && i < MAX_PAGES_INFO; i++) {
-    if(p->pages[i].state == RESIDENT)
-      num_resident++;
-    else if(p->pages[i].state == SWAPPED)
-      num_swapped++;
-  }
-  
-  info.num_pages_total = num_total;
-  info.num_resident_pages = num_resident;
-  info.num_swapped_pages = num_swapped;
-  
-  // Copy page information (up to MAX_PAGES_INFO)
-  int pages_to_copy = p->num_pages < MAX_PAGES_INFO ? p->num_pages : MAX_PAGES_INFO;
-  for(int i = 0; i < pages_to_copy; i++) {
-    info.pages[i].va = (uint)p->pages[i].va;
-    info.pages[i].state = p->pages[i].state;
-    info.pages[i].is_dirty = p->pages[i].is_dirty;
-    info.pages[i].seq = p->pages[i].seq;
-    info.pages[i].swap_slot = p->pages[i].swap_slot;
-  }
-  
-  // Copy the structure to user space
-  if(copyout(p->pagetable, addr, (char*)&info, sizeof(info)) < 0)
+  vmstatfill(&st);
+  if(copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0)
     return -1;
-  
   return 0;
 }
+
+// copy out the per-hart page-fault latency histograms.
+uint64
+sys_faultstat(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return faultstatout(addr);
+}
+
+// set the same-page merging scan rate, in pages per tick.
+// 0 turns it off. returns the old rate.
+uint64
+sys_ksm(void)
+{
+  int rate;
+
+  argint(0, &rate);
+  if(rate < 0)
+    return -1;
+  return ksmrate(rate);
+}
+
+// turn the compressed swap tier on (1) or off (0).
+// returns the old setting.
+uint64
+sys_zswap(void)
+{
+  int on;
+
+  argint(0, &on);
+  return zswapctl(on);
+}
+
+// copy up to n records from the kernel trace buffer.
+uint64
+sys_traceread(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  if(n < 0)
+    return -1;
+  return traceread(addr, n);
+}
+
+// turn console echo of trace records on or off.
+// returns the old setting.
+uint64
+sys_traceecho(void)
+{
+  int on, old;
+
+  argint(0, &on);
+  old = traceecho;
+  traceecho = on != 0;
+  return old;
+}
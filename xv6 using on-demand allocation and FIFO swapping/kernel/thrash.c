@@ -0,0 +1,204 @@
+//
+// Thrashing detection and load control.
+//
+// Every THRASH_WINDOW ticks the scheduler calls thrash_check(),
+// which looks at how many demand-paging faults happened in the
+// window and what fraction of it was spent in swap I/O. When
+// both are high the system is thrashing: suspend the lowest
+// priority process that is paging, so the others can keep their
+// working sets resident. When the fault rate drops, resume the
+// suspended processes one window at a time.
+//
+// A suspended process is not pulled off the CPU where it stands,
+// since it may hold sleep-locks or be inside a log operation.
+// It parks itself on its next return to user space, where it
+// holds nothing (thrash_park()). While parked, its resident pages
+// are the first eviction candidates for any process that runs
+// out of memory (thrash_reclaim()).
+//
+// Decisions go to the trace buffer, not the console.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+extern struct proc proc[NPROC];
+extern struct proc *initproc;
+
+struct {
+  struct spinlock lock;
+  uint start;          // ticks at start of the current window
+  uint64 tstart;       // r_time() at start of the current window
+  uint64 faults;       // faults in the current window
+  uint64 iotime;       // swap I/O time in the current window
+  int thrashing;
+} lc;
+
+void
+thrashinit(void)
+{
+  initlock(&lc.lock, "loadctl");
+  lc.tstart = r_time();
+}
+
+// Count a demand-paging fault taken by p.
+void
+thrash_fault(struct proc *p)
+{
+  __sync_fetch_and_add(&lc.faults, 1);
+  __sync_fetch_and_add(&p->win_faults, 1);
+}
+
+// Charge swap I/O that started at r_time() == t0.
+void
+thrash_io(uint64 t0)
+{
+  __sync_fetch_and_add(&lc.iotime, r_time() - t0);
+}
+
+// xv6 has no process priorities. As in classic load control,
+// treat the most recently created process (highest pid) as the
+// lowest priority. Only processes that are paging are candidates,
+// and at least one of those is always left running.
+// Caller must hold lc.lock.
+static struct proc*
+pickvictim(void)
+{
+  struct proc *p, *v = 0;
+  int active = 0;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p == initproc || p->suspended || p->win_faults == 0)
+      continue;
+    acquire(&p->lock);
+    if(p->state == RUNNABLE || p->state == RUNNING || p->state == SLEEPING){
+      active++;
+      if(v == 0 || p->pid > v->pid)
+        v = p;
+    }
+    release(&p->lock);
+  }
+  return active > 1 ? v : 0;
+}
+
+// Highest priority (lowest pid) suspended process, or 0.
+// Caller must hold lc.lock.
+static struct proc*
+pickresume(void)
+{
+  struct proc *p, *r = 0;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    if(p->suspended && (r == 0 || p->pid < r->pid))
+      r = p;
+  }
+  return r;
+}
+
+// Called by each CPU's scheduler loop. Does nothing
+// until the current window has ended.
+void
+thrash_check(void)
+{
+  struct proc *p;
+  uint64 faults, iopct, elapsed;
+
+  if(ticks - lc.start < THRASH_WINDOW)
+    return;
+
+  acquire(&lc.lock);
+  if(ticks - lc.start < THRASH_WINDOW){
+    // another CPU got here first.
+    release(&lc.lock);
+    return;
+  }
+
+  faults = lc.faults;
+  elapsed = r_time() - lc.tstart;
+  iopct = elapsed ? lc.iotime * 100 / elapsed : 0;
+
+  if(faults >= THRASH_FAULTS_HI && iopct >= THRASH_IO_PCT){
+    if(!lc.thrashing)
+      trace(TR_THRASH, 0, faults, iopct);
+    lc.thrashing = 1;
+    if((p = pickvictim()) != 0){
+      p->suspended = 1;
+      trace(TR_SUSPEND, p->pid, faults, iopct);
+    }
+  } else if(faults < THRASH_FAULTS_LO){
+    if(lc.thrashing)
+      trace(TR_CALM, 0, faults, iopct);
+    lc.thrashing = 0;
+    if((p = pickresume()) != 0){
+      p->suspended = 0;
+      wakeup(&p->suspended);
+      trace(TR_RESUME, p->pid, faults, iopct);
+    }
+  }
+
+  // start the next window.
+  for(p = proc; p < &proc[NPROC]; p++)
+    p->win_faults = 0;
+  lc.faults = 0;
+  lc.iotime = 0;
+  lc.start = ticks;
+  lc.tstart = r_time();
+  release(&lc.lock);
+}
+
+// Called on the way back to user space. If load control has
+// suspended p, wait here until it is resumed or killed.
+void
+thrash_park(struct proc *p)
+{
+  if(p->suspended == 0)
+    return;
+
+  acquire(&lc.lock);
+  p->parked = 1;
+  while(p->suspended && !killed(p))
+    sleep(&p->suspended, &lc.lock);
+  p->suspended = 0;
+  p->parked = 0;
+  // don't touch our pages while someone is evicting them.
+  while(p->evicting)
+    sleep(&p->evicting, &lc.lock);
+  release(&lc.lock);
+}
+
+// Evict one page from a parked process to make room.
+// Returns 1 if a page was freed, -1 if there was none to take.
+int
+thrash_reclaim(void)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&lc.lock);
+    if(!p->parked || p->evicting){
+      release(&lc.lock);
+      continue;
+    }
+    p->evicting = 1;
+    release(&lc.lock);
+
+    int r = lazy_evict_page(p);
+
+    acquire(&lc.lock);
+    p->evicting = 0;
+    wakeup(&p->evicting);
+    release(&lc.lock);
+
+    if(r > 0){
+      trace(TR_RECLAIM, p->pid, 0, 0);
+      return 1;
+    }
+  }
+  return -1;
+}
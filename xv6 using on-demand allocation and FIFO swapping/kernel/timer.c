@@ -0,0 +1,132 @@
+//
+// Timer wheel for timed sleeps.
+//
+// pause() and the other timed sleeps used to sleep on &ticks, and
+// the clock interrupt woke every one of them on every tick just
+// so they could see whether their time was up. Now each sleeper
+// puts its process's timer on a hierarchical wheel, and the clock
+// interrupt wakes only the ones whose time has come. On a tick
+// with nothing due, nothing becomes RUNNABLE and idle harts go
+// straight back to wfi.
+//
+// Three levels of 64 slots. Level 0 holds the timers due within
+// 64 ticks, one slot per tick; level 1 those due within 64*64,
+// one slot per 64 ticks; level 2 the rest, one slot per 4096.
+// Each time level 0 comes round, the next level 1 slot is
+// cascaded: its timers are added again, and are now close enough
+// to land in level 0. Level 2 cascades into level 1 the same way.
+// Timers further out than level 2 reaches wait in the level 2
+// slot that will be cascaded last, and are added again from there.
+//
+// The wheel is protected by tickslock and turns with ticks.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define TW_BITS   6
+#define TW_SIZE   (1 << TW_BITS)
+#define TW_MASK   (TW_SIZE - 1)
+#define TW_LEVELS 3
+
+static struct timer *wheel[TW_LEVELS][TW_SIZE];
+
+// Put t in the slot for t->expires, which is after ticks.
+static void
+twadd(struct timer *t)
+{
+  uint d = t->expires - ticks;
+  struct timer **slot;
+
+  if(d < TW_SIZE)
+    slot = &wheel[0][t->expires & TW_MASK];
+  else if(d < TW_SIZE * TW_SIZE)
+    slot = &wheel[1][(t->expires >> TW_BITS) & TW_MASK];
+  else if(d < TW_SIZE * TW_SIZE * TW_SIZE)
+    slot = &wheel[2][(t->expires >> 2*TW_BITS) & TW_MASK];
+  else
+    slot = &wheel[2][((ticks >> 2*TW_BITS) - 1) & TW_MASK];
+  t->next = *slot;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+}
+
+static void
+twdel(struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->pprev = 0;
+}
+
+// Add the timers in a slot again, against the current ticks.
+static void
+cascade(int level, int i)
+{
+  struct timer *t, *next;
+
+  t = wheel[level][i];
+  wheel[level][i] = 0;
+  for(; t; t = next){
+    next = t->next;
+    twadd(t);
+  }
+}
+
+// Wake the sleepers whose time has come.
+// Called by clockintr() with tickslock held, after ticks++.
+void
+timer_tick(void)
+{
+  struct timer *t, *next;
+  int i;
+
+  if((ticks & TW_MASK) == 0){
+    i = (ticks >> TW_BITS) & TW_MASK;
+    cascade(1, i);
+    if(i == 0)
+      cascade(2, (ticks >> 2*TW_BITS) & TW_MASK);
+  }
+
+  t = wheel[0][ticks & TW_MASK];
+  wheel[0][ticks & TW_MASK] = 0;
+  for(; t; t = next){
+    next = t->next;
+    t->pprev = 0;
+    wakeup(t);
+  }
+}
+
+// Sleep for n ticks. Returns -1 if the process is killed
+// first, 0 otherwise.
+int
+timer_sleep(uint n)
+{
+  struct proc *p = myproc();
+  struct timer *t = &p->timer;
+  int r = 0;
+
+  if(n == 0)
+    return 0;
+  acquire(&tickslock);
+  t->expires = ticks + n;
+  twadd(t);
+  while(t->pprev){
+    if(killed(p)){
+      twdel(t);
+      r = -1;
+      break;
+    }
+    sleep(t, &tickslock);
+  }
+  release(&tickslock);
+  return r;
+}
@@ -0,0 +1,244 @@
+//
+// Kernel trace buffer.
+//
+// Fixed-size rings of binary records for kernel events that are
+// too frequent, or happen at too sensitive a moment, to print on
+// the console: paging and load control. Each hart appends to its
+// own ring with interrupts off, so recording takes no lock and
+// never waits for the UART. Old records are overwritten.
+//
+// User space drains the rings with traceread(). traceecho(1)
+// also prints each record on the console as it is made, the way
+// the paging code used to, and ^P prints what the rings hold.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+struct tracering {
+  uint64 n;                      // records ever written
+  uint64 rd;                     // next record for traceread()
+  struct trace_rec ring[NTRACE];
+};
+
+struct tracering trings[NCPU];
+
+// Serializes readers; writers never take it.
+struct spinlock trlock;
+
+int traceecho;  // also print records on the console
+
+void
+traceinit(void)
+{
+  initlock(&trlock, "trace");
+}
+
+// Print r the way the console log used to show it.
+static void
+traceprint(struct trace_rec *r)
+{
+  static char *causes[] = {
+  [TRF_SWAP]    "swap",
+  [TRF_STACK]   "stack",
+  [TRF_HEAP]    "heap",
+  [TRF_EXEC]    "exec",
+  [TRF_INVALID] "invalid",
+  };
+  static char *areas[] = {
+  [VMA_TEXT]    "text",
+  [VMA_DATA]    "data",
+  [VMA_STACK]   "stack",
+  [VMA_HEAP]    "heap",
+  };
+  char *access = (r->arg1 & TRF_WRITE) ? "write" : "read";
+  uint64 c = r->arg1 & ~TRF_WRITE;
+
+  switch(r->type){
+  case TR_THRASH:
+    printf("THRASH faults=%ld io=%ld%%\n", r->arg0, r->arg1);
+    break;
+  case TR_CALM:
+    printf("CALM faults=%ld io=%ld%%\n", r->arg0, r->arg1);
+    break;
+  case TR_SUSPEND:
+    printf("[pid %d] SUSPEND faults=%ld io=%ld%%\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_RESUME:
+    printf("[pid %d] RESUME faults=%ld io=%ld%%\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_RECLAIM:
+    printf("[pid %d] RECLAIM\n", r->pid);
+    break;
+  case TR_FAULT:
+    printf("[pid %d] PAGEFAULT va=0x%lx access=%s cause=%s\n", r->pid, r->arg0, access,
+           c < NELEM(causes) && causes[c] ? causes[c] : "unknown");
+    break;
+  case TR_ALLOC:
+    printf("[pid %d] ALLOC va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_LOADEXEC:
+    printf("[pid %d] LOADEXEC va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_RESIDENT:
+    printf("[pid %d] RESIDENT va=0x%lx seq=%ld\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_SWAPIN:
+    printf("[pid %d] SWAPIN va=0x%lx slot=%ld\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_VICTIM:
+    printf("[pid %d] VICTIM va=0x%lx seq=%ld\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_SWAPOUT:
+    printf("[pid %d] SWAPOUT va=0x%lx slot=%ld\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_DISCARD:
+    printf("[pid %d] DISCARD va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_EVICT:
+    printf("[pid %d] EVICT va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_MEMFULL:
+    printf("[pid %d] MEMFULL\n", r->pid);
+    break;
+  case TR_KILL:
+    if(c == TRK_SWAPFULL)
+      printf("[pid %d] KILL swap-exhausted\n", r->pid);
+    else
+      printf("[pid %d] KILL invalid-access va=0x%lx access=%s\n", r->pid, r->arg0, access);
+    break;
+  case TR_ZEROMAP:
+    printf("[pid %d] ZEROMAP va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_ZEROCOPY:
+    printf("[pid %d] ZEROCOPY va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_ZSTORE:
+    printf("[pid %d] ZSTORE va=0x%lx entry=%ld\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_ZLOAD:
+    printf("[pid %d] ZLOAD va=0x%lx entry=%ld\n", r->pid, r->arg0, r->arg1);
+    break;
+  case TR_PREFETCH:
+    printf("[pid %d] PREFETCH va=0x%lx\n", r->pid, r->arg0);
+    break;
+  case TR_LAZYMAP:
+    printf("[pid %d] INIT-LAZYMAP %s=[0x%lx,0x%lx)\n", r->pid,
+           (r->arg0 & 0xfff) < NELEM(areas) && areas[r->arg0 & 0xfff] ? areas[r->arg0 & 0xfff] : "unknown",
+           r->arg0 & ~0xfffUL, r->arg1);
+    break;
+  case TR_SWAPCLEANUP:
+    printf("[pid %d] SWAPCLEANUP freed_slots=%ld\n", r->pid, r->arg0);
+    break;
+  default:
+    printf("[pid %d] ??? type=%d 0x%lx 0x%lx\n", r->pid, r->type, r->arg0, r->arg1);
+    break;
+  }
+}
+
+// Append a record to this hart's ring. Safe to call with
+// spinlocks held, and from interrupt handlers.
+void
+trace(int type, int pid, uint64 arg0, uint64 arg1)
+{
+  struct tracering *t;
+  struct trace_rec *r, rec;
+
+  push_off();
+  t = &trings[cpuid()];
+  r = &t->ring[t->n % NTRACE];
+  r->time = r_time();
+  r->type = type;
+  r->hart = cpuid();
+  r->pid = pid;
+  r->arg0 = arg0;
+  r->arg1 = arg1;
+  // publish the record before the count that covers it.
+  __sync_synchronize();
+  t->n++;
+  rec = *r;
+  pop_off();
+
+  if(traceecho)
+    traceprint(&rec);
+}
+
+// Copy up to max unread records from hart's ring into buf.
+// A record the hart overwrites during the copy is dropped, and
+// so are records it overwrote before they were read.
+static int
+traceget(int hart, struct trace_rec *buf, int max)
+{
+  struct tracering *t = &trings[hart];
+  uint64 n, i, start, end, lo;
+
+  n = __atomic_load_n(&t->n, __ATOMIC_ACQUIRE);
+  start = t->rd;
+  // record n - NTRACE shares its slot with record n, which
+  // the hart may be writing now.
+  if(n >= NTRACE && start < n - NTRACE + 1)
+    start = n - NTRACE + 1;
+  end = n - start > max ? start + max : n;
+  for(i = start; i < end; i++)
+    buf[i - start] = t->ring[i % NTRACE];
+  __sync_synchronize();
+  t->rd = end;
+
+  // drop the ones that were overwritten meanwhile.
+  n = __atomic_load_n(&t->n, __ATOMIC_ACQUIRE);
+  lo = n >= NTRACE ? n - NTRACE + 1 : 0;
+  if(lo > start){
+    if(lo > end)
+      lo = end;
+    memmove(buf, buf + (lo - start), (end - lo) * sizeof(*buf));
+    start = lo;
+  }
+  return end - start;
+}
+
+// Copy unread records to user address addr, at most n of them,
+// each hart's in order. Returns the number copied.
+int
+traceread(uint64 addr, int n)
+{
+  struct trace_rec buf[8];
+  int hart, k, total = 0;
+
+  for(hart = 0; hart < NCPU && total < n; hart++){
+    for(;;){
+      acquire(&trlock);
+      k = traceget(hart, buf, n - total < NELEM(buf) ? n - total : NELEM(buf));
+      release(&trlock);
+      if(k == 0)
+        break;
+      if(either_copyout(1, addr + total * sizeof(buf[0]), buf, k * sizeof(buf[0])) < 0)
+        return -1;
+      total += k;
+      if(total >= n)
+        break;
+    }
+  }
+  return total;
+}
+
+// Print the rings to the console. For debugging.
+// No lock to avoid wedging a stuck machine further.
+void
+tracedump(void)
+{
+  struct tracering *t;
+  uint64 i;
+
+  for(t = trings; t < &trings[NCPU]; t++){
+    i = t->n > NTRACE ? t->n - NTRACE : 0;
+    for(; i < t->n; i++){
+      printf("%ld hart %d: ", t->ring[i % NTRACE].time, t->ring[i % NTRACE].hart);
+      traceprint(&t->ring[i % NTRACE]);
+    }
+  }
+}
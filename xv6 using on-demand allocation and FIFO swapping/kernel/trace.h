@@ -0,0 +1,56 @@
+// trace.h - Binary records in the kernel trace buffer
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "types.h"
+
+#define NTRACE 256  // records kept per hart
+
+// Record types
+#define TR_THRASH       1  // load control: thrashing detected (faults, io%)
+#define TR_CALM         2  // load control: pressure dropped (faults, io%)
+#define TR_SUSPEND      3  // load control: process suspended
+#define TR_RESUME       4  // load control: process resumed
+#define TR_RECLAIM      5  // page taken from a suspended process
+#define TR_FAULT        6  // page fault (va, TRF_* cause)
+#define TR_ALLOC        7  // zero page mapped (va)
+#define TR_LOADEXEC     8  // page read from the executable (va)
+#define TR_RESIDENT     9  // page now resident (va, FIFO seq)
+#define TR_SWAPIN      10  // page read from swap (va, slot)
+#define TR_VICTIM      11  // page chosen for eviction (va, FIFO seq)
+#define TR_SWAPOUT     12  // page written to swap (va, slot)
+#define TR_DISCARD     13  // clean page dropped (va)
+#define TR_EVICT       14  // page unmapped (va)
+#define TR_MEMFULL     15  // no memory even after eviction
+#define TR_KILL        16  // process killed (va, TRK_* reason)
+#define TR_SWAPCLEANUP 17  // swap file released (slots in use)
+#define TR_ZEROMAP     18  // shared zero page mapped (va)
+#define TR_ZEROCOPY    19  // write to the zero page got its own frame (va)
+#define TR_ZSTORE      20  // page compressed into zswap (va, entry)
+#define TR_ZLOAD       21  // page decompressed from zswap (va, entry)
+#define TR_PREFETCH    22  // page pre-mapped by the fault predictor (va)
+#define TR_LAZYMAP     23  // area set up by exec (start | VMA_* type, end)
+
+// TR_FAULT causes, or'd with TRF_WRITE for a write
+#define TRF_SWAP    1
+#define TRF_STACK   2
+#define TRF_HEAP    3
+#define TRF_EXEC    4
+#define TRF_INVALID 5
+#define TRF_WRITE   0x100
+
+// TR_KILL reasons
+#define TRK_SWAPFULL 1  // swap-exhausted
+#define TRK_INVALID  2  // invalid-access; or'd with TRF_WRITE
+
+struct trace_rec {
+  uint64 time;   // r_time() when recorded
+  ushort type;   // TR_*
+  ushort hart;   // hart that recorded it
+  int pid;       // process the record is about
+  uint64 arg0;   // type-specific
+  uint64 arg1;   // type-specific
+};
+
+#endif // _TRACE_H_
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "trace.h"
 
 struct spinlock tickslock;
 uint ticks;
@@ -73,7 +74,6 @@ usertrap(void)
     // write_fault should only be true for store faults.
     int write_fault = (r_scause() == 15);
     uint64 va = r_stval();
-    const char *access_type = write_fault ? "write" : "read";
 
     // Try lazy fault handler first
     if(lazy_handle_fault(p, va, write_fault) == 0) {
@@ -81,9 +81,10 @@ usertrap(void)
     } else {
       // Fall back to default vmfault (e.g., lazy sbrk pages)
       // vmfault returns 0 on failure, non-zero on success (pa address)
-      if(vmfault(p->pagetable, va, 0) == 0) {
+      if(vmfault(p->pagetable, va, !write_fault) == 0) {
         // Both handlers failed - this is an invalid access
-        printf("[pid %d] KILL invalid-access va=0x%lx access=%s\n", p->pid, va, access_type);
+        trace(TR_KILL, p->pid, va, TRK_INVALID | (write_fault ? TRF_WRITE : 0));
+        VMSTAT_INC(faults_invalid);
         setkilled(p);
       }
     }
@@ -93,17 +94,28 @@ usertrap(void)
     setkilled(p);
   }
 
+  // wait here while load control has us suspended.
+  thrash_park(p);
+
   if(killed(p))
     kexit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt. We hold
+  // nothing here, so ksm.c may rearrange our pages meanwhile.
+  if(which_dev == 2){
+    acquire(&p->lock);
+    p->atuser = 1;
+    release(&p->lock);
     yield();
+    acquire(&p->lock);
+    p->atuser = 0;
+    release(&p->lock);
+  }
 
   prepare_return();
 
   // the user page table to switch to, for trampoline.S
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = uvmsatp(p);
 
   // return to trampoline.S; satp value in a0.
   return satp;
@@ -161,6 +173,18 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+#ifdef USERMAP
+  // whatever runs from here, perhaps another process after
+  // yield(), shouldn't see user memory. restored below.
+  w_sstatus(sstatus & ~SSTATUS_SUM);
+
+  uint64 pc;
+  if((scause == 13 || scause == 15) &&
+     (pc = uaccess_fault(sepc, r_stval(), scause == 15)) != 0){
+    // a page fault in copyin() or copyout().
+    sepc = pc;
+  } else
+#endif
   if((which_dev = devintr()) == 0){
     // interrupt or trap from an unknown source
     printf("scause=0x%lx sepc=0x%lx stval=0x%lx\n", scause, r_sepc(), r_stval());
@@ -183,7 +207,7 @@ clockintr()
   if(cpuid() == 0){
     acquire(&tickslock);
     ticks++;
-    wakeup(&ticks);
+    timer_tick();
     release(&tickslock);
   }
 
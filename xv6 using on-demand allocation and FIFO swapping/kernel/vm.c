@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
+#include "trace.h"
 
 /*
  * the kernel's page table.
@@ -17,6 +18,21 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+static pte_t *walksuper(pagetable_t, uint64, int);
+
+// ASID bits the hardware implements, or 0 if it has none.
+uint64 asidmask;
+
+// ASIDs are handed out in generations. p->asid holds the
+// generation (the bits above asidmask) as well as the ASID.
+// When a generation runs out, a new one starts, and each hart
+// flushes its whole TLB before running anything under it.
+struct {
+  struct spinlock lock;
+  uint64 gen;
+  uint64 next;  // next unused ASID in this generation
+} asids;
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -39,6 +55,8 @@ kvmmake(void)
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // everything from the first 2 MB boundary after etext up to
+  // PHYSTOP is mapped with superpages; see kvmmap().
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -54,11 +72,34 @@ kvmmake(void)
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// wherever va and pa are both superpage-aligned, and at least
+// a superpage of the range is left, map a superpage instead of
+// 512 pages: fewer page-table pages and far fewer TLB misses
+// in the direct map.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 n;
+  pte_t *pte;
+
+  while(sz > 0){
+    if((va % SUPERPGSIZE) == 0 && (pa % SUPERPGSIZE) == 0 && sz >= SUPERPGSIZE){
+      if((pte = walksuper(kpgtbl, va, 1)) == 0 || *pte != 0)
+        panic("kvmmap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      n = SUPERPGSIZE;
+    } else {
+      // ordinary pages up to the next superpage boundary.
+      n = SUPERPGROUNDDOWN(va) + SUPERPGSIZE - va;
+      if(n > sz)
+        n = sz;
+      if(mappages(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    }
+    va += n;
+    pa += n;
+    sz -= n;
+  }
 }
 
 // Initialize the kernel_pagetable, shared by all CPUs.
@@ -66,22 +107,264 @@ void
 kvminit(void)
 {
   kernel_pagetable = kvmmake();
+  initlock(&asids.lock, "asids");
 }
 
 // Switch the current CPU's h/w page table register to
 // the kernel's page table, and enable paging.
+// The kernel always runs with ASID 0.
 void
 kvminithart()
 {
   // wait for any previous writes to the page table memory to finish.
   sfence_vma();
 
+  // find out how many ASID bits are implemented: the
+  // others read back as zero.
+  w_satp(MAKE_SATP(kernel_pagetable) | SATP_ASID(SATP_ASIDMAX));
+  asidmask = (r_satp() >> 44) & SATP_ASIDMAX;
+  if(asids.gen == 0){
+    // first hart up. ASID 0 is the kernel's.
+    asids.gen = asidmask + 1;
+    asids.next = 1;
+  }
+
   w_satp(MAKE_SATP(kernel_pagetable));
 
   // flush stale entries from the TLB.
   sfence_vma();
 }
 
+#ifdef USERMAP
+// Each process gets two ASIDs: p->asid for its user page table
+// and the next one for its kernel page table, see kvmswitch().
+#define ASIDSTEP 2
+#define KASID(p) (((p)->asid + 1) & asidmask)
+#else
+#define ASIDSTEP 1
+#endif
+
+// Flush this hart's TLB of everything tagged with p's ASIDs.
+static void
+asidflush(struct proc *p)
+{
+  sfence_vma_asid(p->asid & asidmask);
+#ifdef USERMAP
+  sfence_vma_asid(KASID(p));
+#endif
+}
+
+// Give p a new ASID if its own is from an old generation, and
+// flush whatever this hart's TLB may hold that is stale for p.
+// Called with interrupts off.
+static void
+asidcheck(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  uint64 gen;
+
+  gen = asids.gen;
+  if((p->asid & ~asidmask) != gen){
+    acquire(&asids.lock);
+    if(asids.next + ASIDSTEP - 1 > asidmask){
+      asids.gen += asidmask + 1;
+      asids.next = 1;
+    }
+    p->asid = asids.gen | asids.next;
+    asids.next += ASIDSTEP;
+    gen = asids.gen;
+    release(&asids.lock);
+  }
+
+  if(c->asidgen != gen){
+    // ASIDs from the last generation are being reused.
+    sfence_vma();
+    c->asidgen = gen;
+  } else if(p->tlbflush || p->lasthart != cpuid()){
+    // p's page table changed while p was off this hart.
+    asidflush(p);
+  }
+  p->tlbflush = 0;
+  p->lasthart = cpuid();
+}
+
+// Return the satp value for p's return to user space, tagged
+// with p's ASID. Called with interrupts off.
+// Without ASIDs, trampoline.S flushes on every switch instead.
+uint64
+uvmsatp(struct proc *p)
+{
+  if(asidmask == 0)
+    return MAKE_SATP(p->pagetable);
+  asidcheck(p);
+  return MAKE_SATP(p->pagetable) | SATP_ASID(p->asid & asidmask);
+}
+
+// Called after p's mapping of va changed. If p last ran here,
+// flush just that page from this hart's TLB; otherwise p's
+// next uvmsatp() flushes its whole ASID.
+void
+uvmfence(struct proc *p, uint64 va)
+{
+  push_off();
+  if(asidmask == 0){
+#ifdef USERMAP
+    // the user window is tagged ASID 0 like the rest of the
+    // kernel, and the trampoline won't flush it.
+    if(p == myproc() && va < UWINSIZE)
+      sfence_vma_page(UWINBASE + va, 0);
+#endif
+  } else if(p == myproc() && p->lasthart == cpuid()){
+    sfence_vma_page(va, p->asid & asidmask);
+#ifdef USERMAP
+    if(va < UWINSIZE)
+      sfence_vma_page(UWINBASE + va, KASID(p));
+#endif
+  } else {
+    p->tlbflush = 1;
+  }
+  pop_off();
+}
+
+#ifdef USERMAP
+// With USERMAP, each process has its own kernel page table: a
+// copy of kernel_pagetable's root whose UWINBASE slots point at
+// the level-1 page-table pages of the process's user page table.
+// The kernel then sees user address va at UWINBASE+va, and
+// copyin()/copyout() are plain loads and stores (uaccess.S).
+// User PTEs have PTE_U, so the window works only while
+// sstatus.SUM is set.
+
+// Allocate the root of a process's kernel page table.
+pagetable_t
+uwinalloc(void)
+{
+  pagetable_t pt;
+
+  if((pt = (pagetable_t)kalloc()) == 0)
+    return 0;
+  memmove(pt, kernel_pagetable, PGSIZE);
+  return pt;
+}
+
+// Copy p's user root entries into its window, the one covering
+// va if all is 0. Returns 1 if anything changed.
+static int
+uwinsync(struct proc *p, uint64 va, int all)
+{
+  int i, lo, hi, changed = 0;
+
+  lo = all ? 0 : PX(2, va);
+  hi = all ? PX(2, UWINSIZE) : lo + 1;
+  for(i = lo; i < hi; i++){
+    if(p->kpagetable[PX(2, UWINBASE) + i] != p->pagetable[i]){
+      p->kpagetable[PX(2, UWINBASE) + i] = p->pagetable[i];
+      changed = 1;
+    }
+  }
+  return changed;
+}
+
+// Switch this hart to p's kernel page table, or back to the
+// shared one if p is 0. The scheduler calls this around swtch(),
+// and kexec() once it has replaced p's user page table.
+void
+kvmswitch(struct proc *p)
+{
+  push_off();
+  if(p == 0){
+    w_satp(MAKE_SATP(kernel_pagetable));
+  } else {
+    uwinsync(p, 0, 1);
+    if(asidmask == 0){
+      w_satp(MAKE_SATP(p->kpagetable));
+    } else {
+      asidcheck(p);
+      w_satp(MAKE_SATP(p->kpagetable) | SATP_ASID(KASID(p)));
+    }
+  }
+  // without ASIDs, the windows of different processes
+  // share ASID 0.
+  if(asidmask == 0)
+    sfence_vma();
+  pop_off();
+}
+
+// Does a copy of len bytes at user address va in pagetable
+// fit the current process's window?
+static int
+uwinok(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+
+  return p != 0 && p->kpagetable != 0 && pagetable == p->pagetable &&
+    va + len >= va && va + len <= UWINSIZE;
+}
+
+// A fault-fixup entry: a page fault at a pc in [start, end)
+// is a user access, which resumes at fixup if it can't be
+// satisfied. The table, in uaccess.S, ends with a zero start.
+struct uaccess_fixup {
+  uint64 start;
+  uint64 end;
+  uint64 fixup;
+};
+extern struct uaccess_fixup uaccess_fixups[];
+
+// Called by kerneltrap() for a page fault at pc touching stval.
+// Returns the pc to resume at: pc itself to retry the access once
+// the page is mapped, the fixup to fail it, or 0 if the fault
+// wasn't in a user access at all.
+uint64
+uaccess_fault(uint64 pc, uint64 stval, int write)
+{
+  struct proc *p = myproc();
+  struct uaccess_fixup *f;
+  uint64 va;
+
+  for(f = uaccess_fixups; f->start; f++)
+    if(pc >= f->start && pc < f->end)
+      break;
+  if(f->start == 0)
+    return 0;
+
+  if(p == 0 || stval < UWINBASE || stval >= UWINBASE + UWINSIZE)
+    return f->fixup;
+  va = PGROUNDDOWN(stval - UWINBASE);
+
+  // the user page table may have grown a level-1 page since
+  // kvmswitch() filled in the window.
+  if(uwinsync(p, va, 0))
+    return pc;
+
+  // mapped, but not for this kind of access, unless
+  // it is a write to a copy-on-write page.
+  if(ismapped(p->pagetable, va)){
+    if(write && lazy_handle_fault(p, va, 1) == 0)
+      return pc;
+    return f->fixup;
+  }
+
+  if(lazy_handle_fault(p, va, write) != 0 && vmfault(p->pagetable, va, !write) == 0)
+    return f->fixup;
+  uwinsync(p, va, 0);
+  return pc;
+}
+
+// Copy between kernel and user memory through the window.
+// Returns 0 on success, -1 on error.
+static int
+uwincopy(char *dst, char *src, uint64 len)
+{
+  int r;
+
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  r = ucopy(dst, src, len);
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+  return r;
+}
+#endif
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -94,15 +377,32 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// If va lies inside a superpage, return the superpage's
+// level-1 leaf PTE instead; see walklevel().
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// Like walk(), but if level is non-zero also set *level to
+// the level of the returned PTE: 0 for an ordinary page,
+// 1 for a superpage.
+pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int *level)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 2; l > 0; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte)) {
+        if(level)
+          *level = l;
+        return pte;
+      }
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
       if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
@@ -111,9 +411,30 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
+  if(level)
+    *level = 0;
   return &pagetable[PX(0, va)];
 }
 
+// Return the address of the level-1 PTE that would map the
+// superpage containing va, creating the level-1 page-table
+// page if alloc!=0.
+static pte_t *
+walksuper(pagetable_t pagetable, uint64 va, int alloc)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if(*pte & PTE_V) {
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      return 0;
+    memset(pagetable, 0, PGSIZE);
+    *pte = PA2PTE(pagetable) | PTE_V;
+  }
+  return &pagetable[PX(1, va)];
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -122,11 +443,12 @@ walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int level;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walklevel(pagetable, va, 0, &level);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
@@ -134,6 +456,8 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(level > 0)
+    pa += PGROUNDDOWN(va) & ((1L << PXSHIFT(level)) - 1);
   return pa;
 }
 
@@ -202,23 +526,89 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
   memmove(mem, src, sz);
 }
 
+// Try to back the superpage-aligned va with a zeroed superpage,
+// mapped with permissions perm. Fails, returning 0, if anything
+// is already mapped in that superpage's range or no physically
+// contiguous memory is free; the caller should then fall back
+// to ordinary pages. Returns the superpage's physical address.
+char *
+uvmsuper(pagetable_t pagetable, uint64 va, int perm)
+{
+  pte_t *pte;
+  char *mem;
+
+  if((va % SUPERPGSIZE) != 0)
+    return 0;
+  if((pte = walksuper(pagetable, va, 1)) == 0 || *pte != 0)
+    return 0;
+  if((mem = ksuperalloc()) == 0)
+    return 0;
+  memset(mem, 0, SUPERPGSIZE);
+  *pte = PA2PTE(mem) | perm | PTE_V;
+  return mem;
+}
+
+// Split the superpage whose level-1 leaf is *pte into
+// ordinary pages with the same permissions, using l0 as the
+// new level-0 page-table page. Returns the level-0 PTE for va.
+static pte_t *
+demote(pte_t *pte, uint64 va, pagetable_t l0)
+{
+  uint64 pa = PTE2PA(*pte);
+  uint64 flags = PTE_FLAGS(*pte);
+
+  for(int i = 0; i < 512; i++)
+    l0[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(l0) | PTE_V;
+  return &l0[PX(0, va)];
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. It's OK if the mappings don't exist.
 // Optionally free the physical memory.
+// A superpage only partly inside the range is demoted
+// to ordinary pages first.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
+  int level;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0) // leaf page table entry allocated?
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += PGSIZE){
+    if((pte = walklevel(pagetable, a, 0, &level)) == 0) // leaf page table entry allocated?
       continue;   
     if((*pte & PTE_V) == 0)  // has physical page been allocated?
       continue;
+    if(level == 1){
+      if((a % SUPERPGSIZE) == 0 && a + SUPERPGSIZE <= end){
+        // the whole superpage goes.
+        if(do_free)
+          ksuperfree((void*)PTE2PA(*pte));
+        *pte = 0;
+        a += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      // only part of it goes. if there's no memory for a
+      // page-table page, use the frame of the page at a,
+      // which is about to be freed anyway.
+      uint64 pa = PTE2PA(*pte) + (a - SUPERPGROUNDDOWN(a));
+      pagetable_t l0 = (pagetable_t)kalloc();
+      if(l0 == 0){
+        if(!do_free)
+          panic("uvmunmap: demote");
+        l0 = (pagetable_t)pa;
+      }
+      pte = demote(pte, a, l0);
+      if((uint64)l0 == pa){
+        *pte = 0;
+        continue;
+      }
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
@@ -229,6 +619,8 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 
 // Allocate PTEs and physical memory to grow a process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Whole superpage-aligned ranges are mapped with superpages
+// when physically contiguous memory is available.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 {
@@ -240,6 +632,10 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
+    if(a + SUPERPGSIZE <= newsz && uvmsuper(pagetable, a, PTE_R|PTE_U|xperm) != 0){
+      a += SUPERPGSIZE - PGSIZE;
+      continue;
+    }
     mem = kalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
@@ -319,14 +715,31 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz, struct proc *parent)
   uint64 pa, i;
   uint flags;
   char *mem;
+  int level;
 
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
+    if((pte = walklevel(old, i, 0, &level)) == 0)
       continue;   // page table entry hasn't been allocated
     if((*pte & PTE_V) == 0)
       continue;   // physical page hasn't been allocated
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(level == 1){
+      // copy a superpage whole if the child can have one,
+      // otherwise one page at a time.
+      if((mem = uvmsuper(new, i, flags)) != 0){
+        memmove(mem, (char*)pa, SUPERPGSIZE);
+        i += SUPERPGSIZE - PGSIZE;
+        continue;
+      }
+      pa += i - SUPERPGROUNDDOWN(i);
+    }
+    if(pa == (uint64)zeropage){
+      // share it; it's read-only.
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -365,6 +778,11 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
   pte_t *pte;
   struct proc *p = myproc();
 
+#ifdef USERMAP
+  if(uwinok(pagetable, dstva, len))
+    return uwincopy((char *)(UWINBASE + dstva), src, len);
+#endif
+
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     if(va0 >= MAXVA)
@@ -390,6 +808,13 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
     pte = walk(pagetable, va0, 0);
     if(pte == 0)
       return -1;
+    // a copy-on-write page gets a private copy first.
+    if((*pte & PTE_COW) && lazy_handle_fault(p, va0, 1) == 0){
+      pa0 = walkaddr(pagetable, va0);
+      pte = walk(pagetable, va0, 0);
+      if(pa0 == 0 || pte == 0)
+        return -1;
+    }
     // forbid copyout over read-only user text pages.
     if((*pte & PTE_W) == 0)
       return -1;
@@ -398,6 +823,9 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    // the write went around the MMU; record it as the
+    // hardware would have, for eviction.
+    *pte |= PTE_D;
 
     len -= n;
     src += n;
@@ -415,6 +843,11 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
   uint64 n, va0, pa0;
   struct proc *p = myproc();
 
+#ifdef USERMAP
+  if(uwinok(pagetable, srcva, len))
+    return uwincopy(dst, (char *)(UWINBASE + srcva), len);
+#endif
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
@@ -427,7 +860,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
       
       // If still not mapped, try vmfault for heap pages
       if(pa0 == 0) {
-        if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
+        if((pa0 = vmfault(pagetable, va0, 1)) == 0) {
           return -1;
         }
       }
@@ -455,6 +888,21 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   int got_null = 0;
   struct proc *p = myproc();
 
+#ifdef USERMAP
+  int r;
+
+  // the string may end well before max; clip at the window's
+  // end rather than giving up on the window.
+  if(max > 0 && uwinok(pagetable, srcva, 1)){
+    if(max > UWINSIZE - srcva)
+      max = UWINSIZE - srcva;
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    r = ucopystr(dst, (char *)(UWINBASE + srcva), max);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return r;
+  }
+#endif
+
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
@@ -467,7 +915,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
       
       // If still not mapped, try vmfault for heap pages
       if(pa0 == 0) {
-        if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
+        if((pa0 = vmfault(pagetable, va0, 1)) == 0) {
           return -1;
         }
       }
@@ -501,7 +949,9 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 }
 
 // allocate and map user memory if process is referencing a page
-// that was lazily allocated in sys_sbrk().
+// that was lazily allocated in sys_sbrk(). read says the access
+// is only a read, which maps the shared zero page read-only
+// instead; a later write gives the page a frame (lazy_cow()).
 // returns 0 if va is invalid or already mapped, or if
 // out of physical memory, and physical address if successful.
 uint64
@@ -517,6 +967,28 @@ vmfault(pagetable_t pagetable, uint64 va, int read)
   if(ismapped(pagetable, va)) {
     return 0;
   }
+
+  if(read){
+    if(mappages(pagetable, va, PGSIZE, (uint64)zeropage, PTE_U|PTE_R|PTE_COW) != 0)
+      return 0;
+    uvmfence(p, va);
+    VMSTAT_INC(faults_sbrk);
+    VMSTAT_INC(zeromaps);
+    trace(TR_ZEROMAP, p->pid, va, 0);
+    lazy_predict(p, va, 0);
+    return (uint64)zeropage;
+  }
+
+  // Anonymous heap above the stack gets a whole superpage
+  // if its aligned range is in bounds and still untouched.
+  uint64 sva = SUPERPGROUNDDOWN(va);
+  if(sva >= p->stack_top && sva + SUPERPGSIZE <= p->sz &&
+     (mem = (uint64)uvmsuper(pagetable, sva, PTE_W|PTE_U|PTE_R)) != 0){
+    uvmfence(p, va);
+    VMSTAT_INC(faults_sbrk);
+    return mem + (va - sva);
+  }
+
   mem = (uint64) kalloc();
   if(mem == 0)
     return 0;
@@ -525,6 +997,9 @@ vmfault(pagetable_t pagetable, uint64 va, int read)
     kfree((void *)mem);
     return 0;
   }
+  uvmfence(p, va);
+  VMSTAT_INC(faults_sbrk);
+  lazy_predict(p, va, 1);
   return mem;
 }
 
@@ -0,0 +1,66 @@
+//
+// Virtual memory areas: the ranges of a process's address space
+// and how a fault fills each one's pages.
+//
+// p->vm holds them in a small array sorted by start address, so
+// a fault finds its area by binary search. exec() adds one area
+// per loadable segment and one for the stack; the heap sbrk()
+// grows above the stack is one more, whose end follows p->sz.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// Add an area to m, keeping it sorted. Returns -1 if m is full,
+// or if the area is empty or overlaps one already there.
+int
+vmaadd(struct vmamap *m, uint64 start, uint64 end, int type, int prot,
+       struct inode *ip, uint64 off, uint64 filesz)
+{
+  struct vma *v;
+  int i;
+
+  if(m->n == NVMA || start >= end)
+    return -1;
+  for(i = m->n; i > 0 && m->vma[i-1].start >= start; i--)
+    ;
+  if((i > 0 && m->vma[i-1].end > start) || (i < m->n && m->vma[i].start < end))
+    return -1;
+  memmove(&m->vma[i+1], &m->vma[i], (m->n - i) * sizeof(struct vma));
+  m->n++;
+
+  v = &m->vma[i];
+  v->start = start;
+  v->end = end;
+  v->type = type;
+  v->prot = prot;
+  v->ip = ip;
+  v->off = off;
+  v->filesz = filesz;
+  return 0;
+}
+
+// The area of p holding va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+  int lo = 0, hi = p->vm.n;
+
+  while(lo < hi){
+    int mid = (lo + hi) / 2;
+    v = &p->vm.vma[mid];
+    if(va < v->start)
+      hi = mid;
+    else if(va >= (v->type == VMA_HEAP ? p->sz : v->end))
+      lo = mid + 1;
+    else
+      return v;
+  }
+  return 0;
+}
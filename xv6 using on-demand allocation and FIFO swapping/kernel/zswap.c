@@ -0,0 +1,326 @@
+//
+// Compressed swap in RAM, ahead of the swap file.
+//
+// lazy_evict_page() offers each page it must write out to
+// zswapstore() first. The page is compressed with a small LZ77
+// coder (an LZ4-like format: literal runs and back references into
+// the same page) and kept in a pool of frames reserved when the tier
+// is turned on. Only when the pool is full, or the page doesn't
+// compress to 3/4 of its size, does the page go to the swap file.
+// Bringing a page back is a decompression instead of a disk read.
+//
+// The pool is carved into 64-byte chunks; each compressed page
+// takes a run of chunks within one pool frame. Entries are named
+// by their index in zswap.ent[], which page_info.zslot holds.
+//
+// Off until zswapctl() turns it on.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "defs.h"
+#include "memstat.h"
+
+#define ZPOOL     512               // pool frames
+#define ZCHUNK    64                // allocation unit
+#define ZNCHUNK   (PGSIZE / ZCHUNK) // chunks per frame
+#define ZMAXLEN   (PGSIZE / 4 * 3)  // store pages that compress to this
+#define NZENT     4096              // compressed pages
+#define ZHASHBITS 10
+#define MINMATCH  4
+
+struct zent {
+  short frame;    // index in pool[], or -1 if the entry is free
+  uchar chunk;    // first chunk
+  uchar nchunk;
+  ushort len;     // compressed bytes
+};
+
+struct {
+  struct spinlock lock;
+  int on;
+  int npool;               // slots of pool[] ever filled
+  char *pool[ZPOOL];       // 0 once given back; see zswapctl()
+  uint64 used[ZPOOL];      // bitmap of chunks in use
+  struct zent ent[NZENT];
+  ushort tab[1 << ZHASHBITS];  // compressor's match finder
+  uchar buf[PGSIZE];       // compressor's output
+} zswap;
+
+static uint
+zhash(uchar *p)
+{
+  uint v = p[0] | p[1] << 8 | p[2] << 16 | (uint)p[3] << 24;
+  return (v * 2654435761U) >> (32 - ZHASHBITS);
+}
+
+// Append one sequence: nlit literals, then a match of mlen bytes
+// off bytes back, or nothing if mlen is 0 (the last sequence).
+static int
+lzput(uchar **opp, uchar *oend, uchar *lit, int nlit, int off, int mlen)
+{
+  uchar *op = *opp, *tok;
+  int n;
+
+  if(op + 1 + nlit + nlit/255 + 1 + 2 + mlen/255 + 1 > oend)
+    return -1;
+  tok = op++;
+  *tok = (nlit < 15 ? nlit : 15) << 4;
+  if(nlit >= 15){
+    for(n = nlit - 15; n >= 255; n -= 255)
+      *op++ = 255;
+    *op++ = n;
+  }
+  memmove(op, lit, nlit);
+  op += nlit;
+  if(mlen){
+    *op++ = off;
+    *op++ = off >> 8;
+    n = mlen - MINMATCH;
+    *tok |= n < 15 ? n : 15;
+    if(n >= 15){
+      for(n -= 15; n >= 255; n -= 255)
+        *op++ = 255;
+      *op++ = n;
+    }
+  }
+  *opp = op;
+  return 0;
+}
+
+// Compress the page at src into dst. Returns the compressed
+// length, or -1 if it would be longer than max.
+static int
+lzcompress(uchar *src, uchar *dst, int max)
+{
+  uchar *ip = src, *anchor = src, *end = src + PGSIZE;
+  uchar *op = dst, *ref;
+  int h, cand, mlen;
+
+  memset(zswap.tab, 0, sizeof(zswap.tab));
+  while(ip + MINMATCH <= end){
+    h = zhash(ip);
+    cand = zswap.tab[h];
+    zswap.tab[h] = ip - src + 1;
+    ref = src + cand - 1;
+    if(cand == 0 || ref[0] != ip[0] || ref[1] != ip[1] ||
+       ref[2] != ip[2] || ref[3] != ip[3]){
+      ip++;
+      continue;
+    }
+    for(mlen = MINMATCH; ip + mlen < end && ip[mlen] == ref[mlen]; mlen++)
+      ;
+    if(lzput(&op, dst + max, anchor, ip - anchor, ip - ref, mlen) < 0)
+      return -1;
+    ip += mlen;
+    anchor = ip;
+  }
+  if(lzput(&op, dst + max, anchor, end - anchor, 0, 0) < 0)
+    return -1;
+  return op - dst;
+}
+
+// Decompress len bytes at src into the page at dst.
+static int
+lzdecompress(uchar *src, int len, uchar *dst)
+{
+  uchar *ip = src, *iend = src + len;
+  uchar *op = dst, *oend = dst + PGSIZE, *ref;
+  int tok, n, off;
+
+  while(ip < iend){
+    tok = *ip++;
+    n = tok >> 4;
+    if(n == 15)
+      do n += *ip; while(*ip++ == 255);
+    if(op + n > oend || ip + n > iend)
+      return -1;
+    memmove(op, ip, n);
+    op += n;
+    ip += n;
+    if(ip >= iend)
+      break;
+    off = ip[0] | ip[1] << 8;
+    ip += 2;
+    n = tok & 15;
+    if(n == 15)
+      do n += *ip; while(*ip++ == 255);
+    n += MINMATCH;
+    ref = op - off;
+    if(ref < dst || op + n > oend)
+      return -1;
+    while(n-- > 0)
+      *op++ = *ref++;  // may overlap
+  }
+  return op == oend ? 0 : -1;
+}
+
+// Find n free chunks in a row in one pool frame, and mark
+// them used. Returns the frame index, or -1.
+static int
+zchunkalloc(int n, int *chunk)
+{
+  uint64 mask = n == ZNCHUNK ? ~0UL : ((1UL << n) - 1);
+
+  for(int f = 0; f < zswap.npool; f++){
+    if(zswap.pool[f] == 0)
+      continue;
+    for(int c = 0; c + n <= ZNCHUNK; c++){
+      if((zswap.used[f] & (mask << c)) == 0){
+        zswap.used[f] |= mask << c;
+        *chunk = c;
+        return f;
+      }
+    }
+  }
+  return -1;
+}
+
+static void
+zentfree(struct zent *e)
+{
+  uint64 mask = e->nchunk == ZNCHUNK ? ~0UL : ((1UL << e->nchunk) - 1);
+
+  zswap.used[e->frame] &= ~(mask << e->chunk);
+  vmstat.zswap_pages--;
+  vmstat.zswap_bytes -= e->len;
+  // with the tier off, the pool drains as pages come back.
+  if(!zswap.on && zswap.used[e->frame] == 0){
+    kfree(zswap.pool[e->frame]);
+    zswap.pool[e->frame] = 0;
+    vmstat.zswap_pool--;
+  }
+  e->frame = -1;
+}
+
+void
+zswapinit(void)
+{
+  initlock(&zswap.lock, "zswap");
+  for(int i = 0; i < NZENT; i++)
+    zswap.ent[i].frame = -1;
+}
+
+// Compress the page at pa into the pool. Returns the entry
+// holding it, or -1 if the tier is off or full or the page
+// doesn't compress.
+int
+zswapstore(char *pa)
+{
+  int len, i, f, c, n;
+  struct zent *e;
+
+  acquire(&zswap.lock);
+  if(!zswap.on){
+    release(&zswap.lock);
+    return -1;
+  }
+  if((len = lzcompress((uchar*)pa, zswap.buf, ZMAXLEN)) < 0){
+    vmstat.zswap_rejects++;
+    release(&zswap.lock);
+    return -1;
+  }
+  n = (len + ZCHUNK - 1) / ZCHUNK;
+  for(i = 0; i < NZENT && zswap.ent[i].frame >= 0; i++)
+    ;
+  if(i == NZENT || (f = zchunkalloc(n, &c)) < 0){
+    vmstat.zswap_full++;
+    release(&zswap.lock);
+    return -1;
+  }
+  e = &zswap.ent[i];
+  e->frame = f;
+  e->chunk = c;
+  e->nchunk = n;
+  e->len = len;
+  memmove(zswap.pool[f] + c * ZCHUNK, zswap.buf, len);
+  vmstat.zswap_stores++;
+  vmstat.zswap_pages++;
+  vmstat.zswap_bytes += len;
+  release(&zswap.lock);
+  return i;
+}
+
+// Decompress entry i into the page at pa, and free the entry.
+void
+zswapload(int i, char *pa)
+{
+  struct zent *e;
+
+  acquire(&zswap.lock);
+  if(i < 0 || i >= NZENT || (e = &zswap.ent[i])->frame < 0)
+    panic("zswapload");
+  if(lzdecompress((uchar*)zswap.pool[e->frame] + e->chunk * ZCHUNK, e->len, (uchar*)pa) < 0)
+    panic("zswapload: corrupt");
+  zentfree(e);
+  vmstat.zswap_loads++;
+  release(&zswap.lock);
+}
+
+// Decompress entry i into the page at pa, keeping the entry.
+void
+zswapread(int i, char *pa)
+{
+  struct zent *e;
+
+  acquire(&zswap.lock);
+  if(i < 0 || i >= NZENT || (e = &zswap.ent[i])->frame < 0)
+    panic("zswapread");
+  if(lzdecompress((uchar*)zswap.pool[e->frame] + e->chunk * ZCHUNK, e->len, (uchar*)pa) < 0)
+    panic("zswapread: corrupt");
+  release(&zswap.lock);
+}
+
+// Free entry i without reading it.
+void
+zswapfree(int i)
+{
+  acquire(&zswap.lock);
+  if(i < 0 || i >= NZENT || zswap.ent[i].frame < 0)
+    panic("zswapfree");
+  zentfree(&zswap.ent[i]);
+  release(&zswap.lock);
+}
+
+// Turn the tier on (reserving its pool, as much of it as
+// there is memory for) or off. Turning it off gives back the
+// pool frames that are empty; pages already in it stay until
+// they are faulted back in, and their frames go as they empty.
+// Returns the old setting.
+int
+zswapctl(int on)
+{
+  char *mem;
+  int old, f;
+
+  acquire(&zswap.lock);
+  if(on){
+    for(f = 0; f < ZPOOL; f++){
+      if(f < zswap.npool && zswap.pool[f] != 0)
+        continue;
+      if((mem = kalloc()) == 0)
+        break;
+      zswap.used[f] = 0;
+      zswap.pool[f] = mem;
+      if(f >= zswap.npool)
+        zswap.npool = f + 1;
+      vmstat.zswap_pool++;
+    }
+  } else {
+    for(f = 0; f < zswap.npool; f++){
+      if(zswap.pool[f] != 0 && zswap.used[f] == 0){
+        kfree(zswap.pool[f]);
+        zswap.pool[f] = 0;
+        vmstat.zswap_pool--;
+      }
+    }
+  }
+  old = zswap.on;
+  zswap.on = on != 0;
+  vmstat.zswap_on = zswap.on;
+  release(&zswap.lock);
+  return old;
+}
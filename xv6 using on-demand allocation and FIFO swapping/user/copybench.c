@@ -0,0 +1,104 @@
+//
+// Kernel copy bandwidth: how fast copyin()/copyout() and
+// readi() move data between user memory and the kernel.
+//
+// pipe: 1 MB through a pipe, 4 KB per write().
+// file: re-read a small file that stays in the buffer cache.
+//
+// Results are in bytes per clock tick.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define CHUNK    4096
+#define PIPEMB   1
+#define FILESZ   (8*1024)
+#define FILEREAD 2000
+
+static char buf[CHUNK];
+
+static void
+report(char *label, uint64 bytes, int t0, int t1)
+{
+  printf("%s: %lu bytes in %d ticks", label, bytes, t1 - t0);
+  if(t1 > t0)
+    printf(", %lu bytes per tick", bytes / (t1 - t0));
+  printf("\n");
+}
+
+static void
+pipebench(void)
+{
+  int fds[2], pid, t0, t1;
+  uint64 total = PIPEMB*1024*1024, n;
+
+  if(pipe(fds) < 0){
+    printf("copybench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("copybench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < total; n += CHUNK)
+      write(fds[1], buf, CHUNK);
+    exit(0);
+  }
+  close(fds[1]);
+  for(n = 0; n < total; ){
+    int r = read(fds[0], buf, CHUNK);
+    if(r <= 0)
+      break;
+    n += r;
+  }
+  close(fds[0]);
+  wait(0);
+  t1 = uptime();
+  report("pipe", n, t0, t1);
+}
+
+static void
+filebench(void)
+{
+  char *name = "copybench.tmp";
+  int fd, i, t0, t1;
+  uint64 n = 0;
+
+  if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+    printf("copybench: create %s failed\n", name);
+    exit(1);
+  }
+  for(i = 0; i < FILESZ; i += CHUNK)
+    write(fd, buf, CHUNK);
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < FILEREAD; i++){
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("copybench: open %s failed\n", name);
+      exit(1);
+    }
+    int r;
+    while((r = read(fd, buf, CHUNK)) > 0)
+      n += r;
+    close(fd);
+  }
+  t1 = uptime();
+  unlink(name);
+  report("file", n, t0, t1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  memset(buf, 'x', sizeof(buf));
+  pipebench();
+  filebench();
+  exit(0);
+}
@@ -0,0 +1,91 @@
+//
+// Print page-fault latency by cause: count, p50, p99 and max.
+//
+// The kernel keeps log2 histograms, so p50 and p99 are the upper
+// edge of the bucket the percentile falls in. Times are in
+// microseconds, assuming qemu's 10 MHz timer.
+//
+// usage: faultlat [-c]
+//   -c also breaks the counts down by CPU.
+//
+
+#include "kernel/types.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+static char *causes[NFLCAUSE] = {
+[FL_STACK] "stack",
+[FL_HEAP]  "heap",
+[FL_EXEC]  "exec",
+[FL_SWAP]  "swap",
+[FL_ZSWAP] "zswap",
+};
+
+static struct faultstat fs;
+
+// upper edge of the bucket holding the pct'th percentile, in us.
+static uint64
+percentile(uint64 *hist, uint64 n, int pct)
+{
+  uint64 want, seen = 0;
+  int b;
+
+  want = (n * pct + 99) / 100;
+  for(b = 0; b < NFLBUCKET; b++){
+    seen += hist[b];
+    if(seen >= want)
+      break;
+  }
+  return (2UL << b) / 10;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 hist[NFLBUCKET], n, max;
+  int c, cpu, b, percpu;
+
+  percpu = argc > 1 && strcmp(argv[1], "-c") == 0;
+  if(faultstat(&fs) < 0){
+    fprintf(2, "faultlat: faultstat failed\n");
+    exit(1);
+  }
+
+  printf("cause      count      p50      p99      max (us)\n");
+  for(c = 0; c < NFLCAUSE; c++){
+    n = max = 0;
+    memset(hist, 0, sizeof(hist));
+    for(cpu = 0; cpu < NCPU; cpu++){
+      for(b = 0; b < NFLBUCKET; b++){
+        hist[b] += fs.hist[cpu][c][b];
+        n += fs.hist[cpu][c][b];
+      }
+      if(fs.max[cpu][c] > max)
+        max = fs.max[cpu][c];
+    }
+    if(n == 0){
+      printf("%s\t%d\n", causes[c], 0);
+      continue;
+    }
+    printf("%s\t%ld\t%ld\t%ld\t%ld\n", causes[c], n,
+           percentile(hist, n, 50), percentile(hist, n, 99), max / 10);
+  }
+
+  if(percpu){
+    printf("\ncpu");
+    for(c = 0; c < NFLCAUSE; c++)
+      printf("\t%s", causes[c]);
+    printf("\n");
+    for(cpu = 0; cpu < NCPU; cpu++){
+      printf("%d", cpu);
+      for(c = 0; c < NFLCAUSE; c++){
+        n = 0;
+        for(b = 0; b < NFLBUCKET; b++)
+          n += fs.hist[cpu][c][b];
+        printf("\t%ld", n);
+      }
+      printf("\n");
+    }
+  }
+  exit(0);
+}
@@ -0,0 +1,102 @@
+//
+// Same-page merging: fork workers whose heaps are byte-identical,
+// turn the merging scanner on, and see how many frames it gets
+// back. Then have every worker write to each of its pages and
+// check that none of them sees another's writes.
+//
+// usage: ksmtest [workers [pages]]
+//
+
+#include "kernel/types.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define RATE    64    // pages per tick while the test runs
+#define SETTLE  20    // ticks without a new merge before we stop
+#define TIMEOUT 1000  // ticks
+
+static void
+worker(int npg, int ready, int go)
+{
+  char *p, c;
+  int i, j;
+
+  if((p = sbrk(npg * 4096)) == (char*)-1)
+    exit(1);
+  // only a few distinct pages, so even one worker has twins.
+  for(i = 0; i < npg; i++)
+    memset(p + i*4096, 'a' + i % 7, 4096);
+  write(ready, "r", 1);
+  read(go, &c, 1);
+
+  for(i = 0; i < npg; i++)
+    *(int*)(p + i*4096) = getpid();
+  for(i = 0; i < npg; i++){
+    if(*(int*)(p + i*4096) != getpid())
+      exit(1);
+    for(j = sizeof(int); j < 4096; j++)
+      if(p[i*4096 + j] != 'a' + i % 7)
+        exit(1);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nw = 4, npg = 64;
+  int ready[2], go[2], i, t0, last, old, st, fail = 0;
+  struct vmstat v0, v;
+  uint64 merged;
+  char c;
+
+  if(argc > 1)
+    nw = atoi(argv[1]);
+  if(argc > 2)
+    npg = atoi(argv[2]);
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf("ksmtest: pipe failed\n");
+    exit(1);
+  }
+  for(i = 0; i < nw; i++){
+    int pid = fork();
+    if(pid < 0){
+      printf("ksmtest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      worker(npg, ready[1], go[0]);
+  }
+  for(i = 0; i < nw; i++)
+    read(ready[0], &c, 1);
+
+  vmstat(&v0);
+  old = ksm(RATE);
+  t0 = last = uptime();
+  merged = v0.ksm_merged;
+  while(uptime() - last < SETTLE && uptime() - t0 < TIMEOUT){
+    pause(1);
+    vmstat(&v);
+    if(v.ksm_merged != merged){
+      merged = v.ksm_merged;
+      last = uptime();
+    }
+  }
+  ksm(old);
+  vmstat(&v);
+  printf("%d workers x %d pages: merged %ld, saved %ld, free pages %ld -> %ld in %d ticks\n",
+         nw, npg, v.ksm_merged - v0.ksm_merged, v.ksm_saved - v0.ksm_saved,
+         v0.freepages, v.freepages, last - t0);
+
+  for(i = 0; i < nw; i++)
+    write(go[1], "g", 1);
+  for(i = 0; i < nw; i++){
+    wait(&st);
+    if(st != 0)
+      fail = 1;
+  }
+  vmstat(&v);
+  printf("after writes: cow copies %ld, saved %ld\n", v.cowcopies - v0.cowcopies, v.ksm_saved);
+  printf(fail ? "ksmtest: FAILED\n" : "ksmtest: OK\n");
+  exit(fail);
+}
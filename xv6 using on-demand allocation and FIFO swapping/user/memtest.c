@@ -3,47 +3,73 @@
 #include "user/user.h"
 #include "kernel/memstat.h"
 
+#define NSTAT 32
+
+struct page_stat st[NSTAT];
+
+// Page through all of pid's pages with memstat(),
+// printing the first few and counting the rest.
+static int
+show(int pid)
+{
+  uint64 va = 0;
+  int i, n, total = 0, resident = 0, swapped = 0, zero = 0;
+
+  while((n = memstat(pid, va, st, NSTAT)) > 0){
+    for(i = 0; i < n; i++){
+      if(total + i < 5)
+        printf("  va=0x%lx state=%d dirty=%d seq=%d slot=%d\n",
+               st[i].va, st[i].state, st[i].is_dirty, st[i].seq, st[i].swap_slot);
+      if(st[i].state == RESIDENT)
+        resident++;
+      else if(st[i].state == SWAPPED)
+        swapped++;
+      if(st[i].is_zero)
+        zero++;
+    }
+    total += n;
+    va = st[n-1].va + 4096;
+  }
+  if(n < 0)
+    return -1;
+  printf("Pages: %d resident (%d zero), %d swapped\n", resident, zero, swapped);
+  return resident;
+}
+
 int
 main(int argc, char *argv[])
 {
-  struct proc_mem_stat info;
-  
+  int before, after;
+
   printf("Testing memstat system call:\n");
   
-  if(memstat(&info) < 0) {
+  if((before = show(0)) < 0) {
     printf("memstat failed\n");
     exit(1);
   }
   
-  printf("PID: %d\n", info.pid);
-  printf("Total pages: %d\n", info.num_pages_total);
-  printf("Resident pages: %d\n", info.num_resident_pages);
-  printf("Swapped pages: %d\n", info.num_swapped_pages);
-  printf("Next FIFO seq: %d\n", info.next_fifo_seq);
-  
-  printf("First few pages:\n");
-  for(int i = 0; i < 5 && i < MAX_PAGES_INFO; i++) {
-    if(info.pages[i].va > 0 || info.pages[i].state != UNMAPPED) {
-      printf("  va=0x%x state=%d dirty=%d seq=%d slot=%d\n",
-             info.pages[i].va, info.pages[i].state, 
-             info.pages[i].is_dirty, info.pages[i].seq, 
-             info.pages[i].swap_slot);
-    }
-  }
-  
   // Test malloc to create heap allocation
   char *ptr = malloc(4096);
   if(ptr) {
     *ptr = 'A';  // Make it dirty
     printf("Allocated and accessed heap page\n");
     
-    if(memstat(&info) < 0) {
+    if((after = show(0)) < 0) {
       printf("second memstat failed\n");
       exit(1);
     }
-    printf("After malloc - Resident: %d\n", info.num_resident_pages);
+    printf("After malloc - Resident: %d (was %d)\n", after, before);
     free(ptr);
   }
+
+  if(memstat(1, 0, st, 1) != 1) {
+    printf("memstat of init failed\n");
+    exit(1);
+  }
+  if(memstat(12345, 0, st, 1) >= 0) {
+    printf("memstat of a missing pid succeeded\n");
+    exit(1);
+  }
   
   exit(0);
 }
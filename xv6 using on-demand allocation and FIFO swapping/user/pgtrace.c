@@ -0,0 +1,84 @@
+//
+// Read the kernel's paging trace buffer.
+//
+// usage: pgtrace           print and drain the records so far
+//        pgtrace -f        keep following new records
+//        pgtrace echo on   also print records on the console
+//        pgtrace echo off  as they are made (the default is off)
+//
+
+#include "kernel/types.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+static char *names[] = {
+[TR_THRASH]       "THRASH",
+[TR_CALM]         "CALM",
+[TR_SUSPEND]      "SUSPEND",
+[TR_RESUME]       "RESUME",
+[TR_RECLAIM]      "RECLAIM",
+[TR_FAULT]        "PAGEFAULT",
+[TR_ALLOC]        "ALLOC",
+[TR_LOADEXEC]     "LOADEXEC",
+[TR_RESIDENT]     "RESIDENT",
+[TR_SWAPIN]       "SWAPIN",
+[TR_VICTIM]       "VICTIM",
+[TR_SWAPOUT]      "SWAPOUT",
+[TR_DISCARD]      "DISCARD",
+[TR_EVICT]        "EVICT",
+[TR_MEMFULL]      "MEMFULL",
+[TR_KILL]         "KILL",
+[TR_SWAPCLEANUP]  "SWAPCLEANUP",
+[TR_ZEROMAP]      "ZEROMAP",
+[TR_ZEROCOPY]     "ZEROCOPY",
+[TR_ZSTORE]       "ZSTORE",
+[TR_ZLOAD]        "ZLOAD",
+[TR_PREFETCH]     "PREFETCH",
+[TR_LAZYMAP]      "INIT-LAZYMAP",
+};
+
+static struct trace_rec buf[64];
+
+// print what is in the buffer now; returns the number printed.
+static int
+drain(void)
+{
+  int i, n, total = 0;
+  char *name;
+
+  while((n = traceread(buf, sizeof(buf)/sizeof(buf[0]))) > 0){
+    for(i = 0; i < n; i++){
+      name = buf[i].type < sizeof(names)/sizeof(names[0]) && names[buf[i].type] ?
+        names[buf[i].type] : "???";
+      printf("%ld %d [pid %d] %s 0x%lx 0x%lx\n", buf[i].time, buf[i].hart,
+             buf[i].pid, name, buf[i].arg0, buf[i].arg1);
+    }
+    total += n;
+  }
+  if(n < 0){
+    fprintf(2, "pgtrace: traceread failed\n");
+    exit(1);
+  }
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 3 && strcmp(argv[1], "echo") == 0){
+    traceecho(strcmp(argv[2], "on") == 0);
+    exit(0);
+  }
+  if(argc == 2 && strcmp(argv[1], "-f") == 0){
+    for(;;){
+      if(drain() == 0)
+        pause(1);
+    }
+  }
+  if(argc != 1){
+    fprintf(2, "usage: pgtrace [-f | echo on|off]\n");
+    exit(1);
+  }
+  drain();
+  exit(0);
+}
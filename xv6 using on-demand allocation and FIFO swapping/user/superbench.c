@@ -0,0 +1,79 @@
+//
+// Random-access throughput over a large heap, mapped first
+// with ordinary 4 KB pages and then with 2 MB superpages.
+//
+// The kernel only uses superpages for whole aligned 2 MB ranges,
+// so the 4 KB heap is grown one page per sbrk() call, and the
+// superpage heap with a single sbrk() once the break is aligned.
+//
+// usage: superbench [megabytes]
+//
+
+#include "kernel/types.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NACCESS (4*1024*1024)
+
+static uint64 seed = 88172645463325252ULL;
+
+static uint64
+xorshift(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static void
+run(char *label, char *heap, uint64 sz)
+{
+  uint64 i, sum = 0;
+  int t0, t1;
+
+  // fault everything in first so only accesses are timed.
+  for(i = 0; i < sz; i += PGSIZE)
+    heap[i] = 1;
+
+  t0 = uptime();
+  for(i = 0; i < NACCESS; i++)
+    sum += heap[xorshift() % sz]++;
+  t1 = uptime();
+
+  printf("%s: %d accesses in %d ticks", label, NACCESS, t1 - t0);
+  if(t1 > t0)
+    printf(", %d per tick", NACCESS / (t1 - t0));
+  printf(" (sum %lu)\n", sum);
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 sz, i;
+  char *heap, *p;
+
+  sz = (argc > 1 ? atoi(argv[1]) : 16) * 1024 * 1024;
+  sz = SUPERPGROUNDUP(sz);
+
+  // 4 KB pages: no single sbrk() covers a superpage.
+  heap = sbrk(0);
+  for(i = 0; i < sz; i += PGSIZE){
+    if(sbrk(PGSIZE) == SBRK_ERROR){
+      printf("superbench: out of memory\n");
+      exit(1);
+    }
+  }
+  run("4K pages  ", heap, sz);
+
+  // superpages: align the break, then grow in one call.
+  p = sbrk(0);
+  if(sbrk(SUPERPGROUNDUP((uint64)p) - (uint64)p) == SBRK_ERROR ||
+     (heap = sbrk(sz)) == SBRK_ERROR){
+    printf("superbench: out of memory\n");
+    exit(1);
+  }
+  run("superpages", heap, sz);
+
+  exit(0);
+}
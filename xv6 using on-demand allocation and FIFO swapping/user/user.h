@@ -1,7 +1,10 @@
 #define SBRK_ERROR ((char *)-1)
 
 struct stat;
-struct proc_mem_stat;
+struct page_stat;
+struct vmstat;
+struct faultstat;
+struct trace_rec;
 
 // system calls
 int fork(void);
@@ -25,7 +28,13 @@ int getpid(void);
 char* sys_sbrk(int,int);
 int pause(int);
 int uptime(void);
-int memstat(struct proc_mem_stat*);
+int memstat(int, uint64, struct page_stat*, int);
+int traceread(struct trace_rec*, int);
+int traceecho(int);
+int vmstat(struct vmstat*);
+int faultstat(struct faultstat*);
+int ksm(int);
+int zswap(int);
 
 // ulib.c
 int stat(const char*, struct stat*);
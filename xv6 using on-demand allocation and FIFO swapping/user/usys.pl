@@ -43,3 +43,9 @@ entry("sbrk");
 entry("pause");
 entry("uptime");
 entry("memstat");
+entry("traceread");
+entry("traceecho");
+entry("vmstat");
+entry("faultstat");
+entry("ksm");
+entry("zswap");
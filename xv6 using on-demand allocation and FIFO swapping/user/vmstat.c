@@ -0,0 +1,98 @@
+//
+// Print the system-wide paging counters.
+//
+// usage: vmstat [-k rate] [-z on|off] [seconds]
+//   -k sets the same-page merging scan rate, in pages per tick
+//   (0 turns it off).
+//   -z turns the compressed swap tier on or off.
+//   with an interval, print the change every interval, forever.
+//
+
+#include "kernel/types.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+static void
+print(struct vmstat *v)
+{
+  printf("faults: stack %ld heap %ld exec %ld swap %ld sbrk %ld invalid %ld\n",
+         v->faults_stack, v->faults_heap, v->faults_exec,
+         v->faults_swap, v->faults_sbrk, v->faults_invalid);
+  printf("zero page: mapped %ld copied %ld\n", v->zeromaps, v->zerocopies);
+  printf("ksm: rate %ld scanned %ld merged %ld saved %ld cow copies %ld\n",
+         v->ksm_rate, v->ksm_scanned, v->ksm_merged, v->ksm_saved, v->cowcopies);
+  printf("zswap: %s, pool %ld, %ld pages in %ld bytes, stored %ld loaded %ld, to disk %ld incompressible %ld full\n",
+         v->zswap_on ? "on" : "off", v->zswap_pool, v->zswap_pages, v->zswap_bytes,
+         v->zswap_stores, v->zswap_loads, v->zswap_rejects, v->zswap_full);
+  printf("predictor: hits %ld misses %ld, pre-mapped %ld, used %ld wasted %ld",
+         v->pf_hits, v->pf_misses, v->pf_pages, v->pf_used, v->pf_wasted);
+  if(v->pf_used + v->pf_wasted)
+    printf(" (%ld%% accurate)", v->pf_used * 100 / (v->pf_used + v->pf_wasted));
+  printf("\n");
+  printf("swapin %ld swapout %ld discard %ld evict %ld\n",
+         v->swapins, v->swapouts, v->discards, v->evictions);
+  printf("free pages %ld, swap slots in use %ld\n", v->freepages, v->swapslots);
+  printf("boot took %ld us\n", v->boot_us);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct vmstat prev, cur, d;
+  int secs;
+
+  while(argc >= 3 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-k") == 0)
+      ksm(atoi(argv[2]));
+    else if(strcmp(argv[1], "-z") == 0)
+      zswap(strcmp(argv[2], "on") == 0);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+  if(vmstat(&cur) < 0){
+    fprintf(2, "vmstat: failed\n");
+    exit(1);
+  }
+  print(&cur);
+  if(argc < 2)
+    exit(0);
+
+  secs = atoi(argv[1]);
+  if(secs <= 0)
+    secs = 1;
+  for(;;){
+    prev = cur;
+    pause(secs * 10);
+    if(vmstat(&cur) < 0)
+      exit(1);
+    d = cur;
+    d.faults_stack -= prev.faults_stack;
+    d.faults_heap -= prev.faults_heap;
+    d.faults_exec -= prev.faults_exec;
+    d.faults_swap -= prev.faults_swap;
+    d.faults_sbrk -= prev.faults_sbrk;
+    d.faults_invalid -= prev.faults_invalid;
+    d.zeromaps -= prev.zeromaps;
+    d.zerocopies -= prev.zerocopies;
+    d.ksm_scanned -= prev.ksm_scanned;
+    d.ksm_merged -= prev.ksm_merged;
+    d.cowcopies -= prev.cowcopies;
+    d.zswap_stores -= prev.zswap_stores;
+    d.zswap_loads -= prev.zswap_loads;
+    d.zswap_rejects -= prev.zswap_rejects;
+    d.zswap_full -= prev.zswap_full;
+    d.pf_hits -= prev.pf_hits;
+    d.pf_misses -= prev.pf_misses;
+    d.pf_pages -= prev.pf_pages;
+    d.pf_used -= prev.pf_used;
+    d.pf_wasted -= prev.pf_wasted;
+    d.swapins -= prev.swapins;
+    d.swapouts -= prev.swapouts;
+    d.discards -= prev.discards;
+    d.evictions -= prev.evictions;
+    printf("\n");
+    print(&d);
+  }
+}
@@ -0,0 +1,166 @@
+//
+// Cost of sleep and wakeup with many processes.
+//
+// Three runs, each timed in ticks:
+//   pingpong  pairs of processes bounce a byte over pipes
+//   disk      processes write, read back, and remove small files,
+//             sleeping on the log, buffers and disk completions
+//   idle      one pair bounces a byte while every other process
+//             sleeps on a pipe of its own
+// Before wakeup() hashed its channels, each wakeup locked every
+// process in the table, so all three slowed down with the number
+// of processes, even the idle one.
+//
+// usage: wakebench [nproc [rounds]]
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define MAXPROC 60   // NPROC less init, sh, wakebench and a spare
+
+// bounce a byte rounds times: read from rfd, write to wfd.
+static void
+bounce(int rfd, int wfd, int serve, int rounds)
+{
+  char c = 0;
+
+  if(serve && write(wfd, &c, 1) != 1)
+    exit(1);
+  for(int i = 0; i < rounds; i++){
+    if(read(rfd, &c, 1) != 1)
+      exit(1);
+    if((i < rounds - 1 || serve == 0) && write(wfd, &c, 1) != 1)
+      exit(1);
+  }
+  exit(0);
+}
+
+// start a pair of processes bouncing a byte rounds times.
+static void
+pair(int rounds)
+{
+  int a[2], b[2];
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("wakebench: pipe failed\n");
+    exit(1);
+  }
+  if(fork() == 0){
+    close(a[0]);
+    close(b[1]);
+    bounce(b[0], a[1], 1, rounds);
+  }
+  if(fork() == 0){
+    close(a[1]);
+    close(b[0]);
+    bounce(a[0], b[1], 0, rounds);
+  }
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(b[1]);
+}
+
+// write a file of 4 blocks, read it back, remove it; n times.
+static void
+diskwork(int id, int n)
+{
+  char name[8], buf[512];
+  int fd;
+
+  name[0] = 'w';
+  name[1] = 'b';
+  name[2] = '0' + id / 10;
+  name[3] = '0' + id % 10;
+  name[4] = 0;
+  memset(buf, id, sizeof(buf));
+  for(int i = 0; i < n; i++){
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0)
+      exit(1);
+    for(int j = 0; j < 4; j++)
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf))
+        exit(1);
+    close(fd);
+    if((fd = open(name, O_RDONLY)) < 0)
+      exit(1);
+    while(read(fd, buf, sizeof(buf)) > 0)
+      ;
+    close(fd);
+    unlink(name);
+  }
+  exit(0);
+}
+
+// wait for n children; returns how many failed.
+static int
+reap(int n)
+{
+  int st, bad = 0;
+
+  for(int i = 0; i < n; i++){
+    if(wait(&st) < 0 || st != 0)
+      bad++;
+  }
+  return bad;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc = MAXPROC, rounds = 500, t, bad;
+  int sleepers[2];
+
+  if(argc > 1)
+    nproc = atoi(argv[1]);
+  if(argc > 2)
+    rounds = atoi(argv[2]);
+  if(nproc < 2 || nproc > MAXPROC || rounds < 10){
+    printf("usage: wakebench [nproc (2-%d) [rounds (>= 10)]]\n", MAXPROC);
+    exit(1);
+  }
+  nproc &= ~1;
+
+  t = uptime();
+  for(int i = 0; i < nproc / 2; i++)
+    pair(rounds);
+  bad = reap(nproc);
+  t = uptime() - t;
+  printf("pingpong: %d procs, %d round trips in %d ticks%s\n",
+         nproc, nproc / 2 * rounds, t, bad ? " (some failed)" : "");
+
+  t = uptime();
+  for(int i = 0; i < nproc; i++){
+    if(fork() == 0)
+      diskwork(i, rounds / 10);
+  }
+  bad = reap(nproc);
+  t = uptime() - t;
+  printf("disk:     %d procs, %d files in %d ticks%s\n",
+         nproc, nproc * (rounds / 10), t, bad ? " (some failed)" : "");
+
+  // the sleepers read a pipe that nobody writes until the end.
+  if(pipe(sleepers) < 0){
+    printf("wakebench: pipe failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < nproc - 2; i++){
+    if(fork() == 0){
+      char c;
+      close(sleepers[1]);
+      read(sleepers[0], &c, 1);
+      exit(0);
+    }
+  }
+  close(sleepers[0]);
+  t = uptime();
+  pair(rounds * 10);
+  bad = reap(2);
+  t = uptime() - t;
+  close(sleepers[1]);
+  reap(nproc - 2);
+  printf("idle:     %d sleepers, %d round trips in %d ticks%s\n",
+         nproc - 2, rounds * 10, t, bad ? " (some failed)" : "");
+  exit(0);
+}
@@ -0,0 +1,166 @@
+//
+// Compressed swap tier against the swap file.
+//
+// A child takes all but a few free pages and holds them, so that
+// the benchmark's own working set, larger than what is left, has
+// to be swapped as it cycles through it. The working set is in
+// bss, since the kernel only evicts pages of the executable's
+// image and stack; the hog's sbrk() heap stays put. The same
+// passes run with the compressed tier on and then off, over
+// text-like pages that compress well and over random pages that
+// don't. The tier's pool is reserved first; turning the tier off
+// gives it back, and the hog takes it up again before each run.
+//
+// Reports ticks per run, pages swapped in from each tier, the
+// compression ratio, and the median swap-in fault latency (upper
+// edge of its log2 bucket, in us, assuming qemu's 10 MHz timer).
+//
+// usage: zswapbench [pages [passes]]
+//
+
+#include "kernel/types.h"
+#include "kernel/memstat.h"
+#include "user/user.h"
+
+#define ROOM  48   // free pages left to the benchmark
+#define MAXPG 256  // largest working set
+
+static char ws[MAXPG*4096];
+static struct faultstat fs0, fs1;
+static volatile uint sink;
+static int cmd[2], ack[2];
+
+static void
+fill(char *p, int npg, int random)
+{
+  static char *words[] = { "the ", "page ", "fault ", "swap ", "of ", "a ", "process ", "kernel " };
+  uint seed = 12345;
+  int i, j;
+
+  for(i = 0; i < npg*4096; ){
+    if(random){
+      seed = seed * 1103515245 + 12345;
+      p[i++] = seed >> 16;
+    } else {
+      seed = seed * 1103515245 + 12345;
+      for(j = 0; words[(seed >> 16) % 8][j] && i < npg*4096; j++)
+        p[i++] = words[(seed >> 16) % 8][j];
+    }
+  }
+}
+
+// median swap-in latency of one cause between the two snapshots.
+static uint64
+median(int cause)
+{
+  uint64 hist[NFLBUCKET], n = 0, seen = 0;
+  int cpu, b;
+
+  memset(hist, 0, sizeof(hist));
+  for(cpu = 0; cpu < NCPU; cpu++)
+    for(b = 0; b < NFLBUCKET; b++){
+      hist[b] += fs1.hist[cpu][cause][b] - fs0.hist[cpu][cause][b];
+      n += fs1.hist[cpu][cause][b] - fs0.hist[cpu][cause][b];
+    }
+  if(n == 0)
+    return 0;
+  for(b = 0; b < NFLBUCKET; b++){
+    seen += hist[b];
+    if(seen >= (n + 1) / 2)
+      break;
+  }
+  return (2UL << b) / 10;
+}
+
+// have the hog take all but ROOM of the free pages.
+static void
+topup(void)
+{
+  char c;
+
+  write(cmd[1], "g", 1);
+  read(ack[0], &c, 1);
+}
+
+static void
+run(char *p, int npg, int passes, int random, int on)
+{
+  struct vmstat v0, v1;
+  int i, k, t0, t1;
+
+  zswap(on);
+  topup();
+  fill(p, npg, random);
+  // pool frames freed as the last run's pages came back.
+  topup();
+  vmstat(&v0);
+  faultstat(&fs0);
+  t0 = uptime();
+  for(k = 0; k < passes; k++)
+    for(i = 0; i < npg; i++){
+      sink += p[i*4096 + k];
+      p[i*4096 + 4095 - k] ^= 1;   // keep it dirty
+    }
+  t1 = uptime();
+  vmstat(&v1);
+  faultstat(&fs1);
+
+  printf("%s %s: %d ticks, swapins %ld disk / %ld zswap, p50 %ld / %ld us",
+         random ? "random" : "text  ", on ? "zswap" : "disk ", t1 - t0,
+         v1.swapins - v0.swapins, v1.zswap_loads - v0.zswap_loads,
+         median(FL_SWAP), median(FL_ZSWAP));
+  if(on && v1.zswap_bytes)
+    printf(", ratio %ld.%ld",
+           v1.zswap_pages * 4096 / v1.zswap_bytes,
+           v1.zswap_pages * 4096 * 10 / v1.zswap_bytes % 10);
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int npg = 128, passes = 4, pid, n, old;
+  struct vmstat v;
+  char *p, *h, c;
+
+  if(argc > 1)
+    npg = atoi(argv[1]);
+  if(argc > 2)
+    passes = atoi(argv[2]);
+  if(npg < 1 || npg > MAXPG || passes < 1 || passes > 4096){
+    printf("usage: zswapbench [pages (1-%d) [passes]]\n", MAXPG);
+    exit(1);
+  }
+  p = ws;
+
+  // take the tier's pool before the hog takes the rest.
+  old = zswap(1);
+
+  if(pipe(cmd) < 0 || pipe(ack) < 0){
+    printf("zswapbench: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) == 0){
+    while(read(cmd[0], &c, 1) == 1){
+      vmstat(&v);
+      // leave room for the hog's own page tables too.
+      n = v.freepages > ROOM + v.freepages/512 + 4 ? v.freepages - ROOM - v.freepages/512 - 4 : 0;
+      if(n > 0 && (h = sbrk(n * 4096)) != (char*)-1){
+        for(int i = 0; i < n; i++)
+          h[i*4096] = 1;
+      }
+      write(ack[1], "r", 1);
+    }
+    exit(0);
+  }
+
+  run(p, npg, passes, 0, 1);
+  run(p, npg, passes, 1, 1);
+  run(p, npg, passes, 0, 0);
+  run(p, npg, passes, 1, 0);
+
+  zswap(old);
+  kill(pid);
+  wait(0);
+  exit(0);
+}